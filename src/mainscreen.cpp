@@ -25,6 +25,8 @@
 #include <pwd.h>
 #include <unistd.h>
 
+#include <mutex>
+#include <future>
 #include <algorithm>
 #include <exception>
 
@@ -34,7 +36,7 @@
 #include "videowindow.h"
 #include "mainscreen.h"
 
-MainScreen::MainScreen(const JsonObject & jo) : DisplayWindow(Color::Black), config(&jo), uid(0), pid(0), sid(0)
+MainScreen::MainScreen(const JsonObject & jo) : DisplayWindow(Color::Black), config(&jo), uid(0), pid(0), sid(0), exportPeriod(100), exportLayout(true)
 {
     colorBack = jo.getString("display:background");
     auto tmp = new FontRenderTTF(jo.getString("font:file"), jo.getInteger("font:size", 12), jo.getBoolean("font:blend", false) ? SWE::RenderBlended : SWE::RenderSolid);
@@ -47,26 +49,62 @@ MainScreen::MainScreen(const JsonObject & jo) : DisplayWindow(Color::Black), con
     // load windows
     if(const JsonArray* ja = jo.getArray("windows"))
     {
+        std::list< std::future<WindowParams> > jobs;
+        std::list<void*> preloads;
+        std::mutex preloadsLock;
+
+        // parse params and open plugin libraries in parallel, the windows created in main thread
 	for(int index = 0; index < ja->size(); ++index)
 	{
-	    const JsonObject* jo2 = ja->getObject(index);
-	    if(jo2)
+	    if(const JsonObject* jo2 = ja->getObject(index))
 	    {
-		try
-                {
-		    windows.emplace_back(std::make_unique<VideoWindow>(WindowParams(*jo2, this), *this));
-                }
-                catch(const std::invalid_argument & err)
+                jobs.emplace_back(std::async(std::launch::async, [this, jo2, &preloads, &preloadsLock]
                 {
-                    ERROR(err.what());
-                }
-	    }
-	}
+                    WindowParams params(*jo2, this);
+
+                    for(auto & plugin : params.plugins)
+                    {
+                        void* lib = params.skip || plugin.file.empty() ? nullptr : PluginLibrary::open(plugin.file);
+
+                        if(lib)
+                        {
+                            const std::lock_guard<std::mutex> lock(preloadsLock);
+                            preloads.push_back(lib);
+                        }
+                    }
+
+                    return params;
+                }));
+            }
+        }
+
+        for(auto & job : jobs)
+        {
+            try
+            {
+                windows.emplace_back(std::make_unique<VideoWindow>(job.get(), *this));
+            }
+            catch(const std::invalid_argument & err)
+            {
+                ERROR(err.what());
+            }
+        }
+
+        // release preload handles, the plugins hold own
+        for(auto & lib : preloads)
+            PluginLibrary::close(lib);
+
+        StartupTimeline::expect(windows.size());
     }
 
     if(windows.empty())
         throw std::runtime_error("active windows not found");
 
+    // signals index: subscribed windows
+    for(auto & win : windows)
+        for(auto & signal : win->signalNames())
+            signalWindows[signal].push_back(win.get());
+
     // load signals
     for(auto & obj : getPluginsType("signal_"))
     {
@@ -114,6 +152,38 @@ MainScreen::MainScreen(const JsonObject & jo) : DisplayWindow(Color::Black), con
 	keymap = map->toStdMap<std::string>();
     }
 
+    // composed screen to storage plugin (video wall)
+    if(jo.isString("display:export"))
+    {
+        auto name = jo.getString("display:export");
+        const JsonObject* jo2 = getPluginName(name);
+        PluginParams params;
+
+        if(jo2)
+            params = PluginParams(*jo2);
+
+        if(! jo2 || ! params.isStorage())
+        {
+            ERROR("display export: storage plugin not found: " << name);
+        }
+        else
+        if(! Systems::isFile(params.file))
+        {
+            ERROR("storage plugin not found: " << params.file);
+        }
+        else
+        if(! params.config.isValid())
+        {
+            ERROR("json config invalid");
+        }
+        else
+        {
+            DEBUG("display export: " << params.name);
+            exportPeriod = 1000 / std::max(1, jo.getInteger("display:export:fps", 10));
+            exportPlugin = std::make_unique<StoragePlugin>(params, *this);
+        }
+    }
+
     setVisible(true);
 }
 
@@ -218,6 +288,7 @@ bool MainScreen::keyPressEvent(const KeySym & key)
 		{
 		    (*ptr)->setSize(newPosition);
 		    (*ptr)->setPosition(newPosition);
+		    exportLayout = true;
 		    DEBUG("set window position: " << newPosition.toString());
 		    renderWindow();
 		}
@@ -297,6 +368,74 @@ void MainScreen::tickEvent(u32 ms)
         dateTimeTexture.reset();
 	dateTimeTexture = Display::renderText(fontRender(), String::strftime(dateTimeFormat), Color::Yellow);
     }
+
+    if(exportPlugin && exportPlugin->isInitComplete() &&
+        ttExport.check(ms, exportPeriod))
+    {
+        exportCompose();
+    }
+}
+
+void MainScreen::exportCompose(void)
+{
+    const std::string dateTime = dateTimeFormat.empty() ? "" : String::strftime(dateTimeFormat);
+    const bool full = exportLayout || ! exportSurface.isValid();
+
+    if(! full && dateTime == exportDateTime &&
+        std::none_of(windows.begin(), windows.end(), [](auto & win){ return win->isExportDirty(); }))
+        return;
+
+    if(full)
+    {
+        exportBackground = Surface(size());
+        exportBackground.clear(colorBack);
+    }
+
+    // new surface for every frame: storage may still send the previous one
+    Surface sf = Surface::copy(full ? exportBackground : exportSurface);
+    std::list<Rect> redraw;
+
+    auto intersects = [](const Rect & rt1, const Rect & rt2)
+    {
+        return rt1.x < rt2.x + rt2.w && rt2.x < rt1.x + rt1.w &&
+                rt1.y < rt2.y + rt2.h && rt2.y < rt1.y + rt1.h;
+    };
+
+    // datetime: under windows
+    if(! full && dateTime != exportDateTime && ! exportDateTime.empty())
+    {
+        Rect rt(dateTimePos, fontRender().stringSize(exportDateTime));
+        SDL_Rect srt = { rt.x, rt.y, rt.w, rt.h };
+        SDL_Rect drt = srt;
+
+        SDL_BlitSurface(exportBackground.toSDLSurface(), & srt, sf.toSDLSurface(), & drt);
+        redraw.push_back(rt);
+    }
+
+    if(! dateTime.empty() && (full || dateTime != exportDateTime))
+    {
+        fontRender().renderString(dateTime, Color::Yellow, dateTimePos, sf);
+        redraw.emplace_back(dateTimePos, fontRender().stringSize(dateTime));
+    }
+
+    // dirty windows and all over redrawn areas
+    for(auto & win : windows)
+    {
+        const Rect & area = win->area();
+
+        if(full || win->isExportDirty() ||
+            std::any_of(redraw.begin(), redraw.end(), [&](auto & rt){ return intersects(rt, area); }))
+        {
+            win->renderExport(sf, exportBackground);
+            redraw.push_back(area);
+        }
+    }
+
+    exportSurface = sf;
+    exportDateTime = dateTime;
+    exportLayout = false;
+
+    exportPlugin->setSurface(exportSurface);
 }
 
 bool MainScreen::userEvent(int act, void* data)
@@ -321,6 +460,22 @@ bool MainScreen::userEvent(int act, void* data)
             }
 	    return true;
 
+        case ActionSignalName:
+            if(auto name = static_cast<const std::string*>(data))
+            {
+                auto it = signalWindows.find(*name);
+
+                if(it != signalWindows.end())
+                {
+                    for(auto & win : (*it).second)
+                        win->actionSignalName(*name);
+                }
+
+                actionSignalName(*name, nullptr);
+            }
+            // broadcast
+            return false;
+
         case ActionPushGallery:
             if(auto plugin = static_cast<StoragePlugin*>(data))
             {
@@ -376,6 +531,7 @@ void MainScreen::actionSignalName(const std::string & name, const VideoWindow* w
 		    DisplayScene::moveTopLayer(*win);
 	    }
 
+	    exportLayout = true;
 	    DisplayScene::setDirty(true);
 	}
     }
@@ -399,3 +555,28 @@ std::string MainScreen::formatString(const std::string & format) const
     }
     return str;
 }
+
+bool MainScreen::formatVariable(const std::string & name, std::string & value) const
+{
+    if(name == "uid")
+        value = std::to_string(getUid());
+    else
+    if(name == "pid")
+        value = std::to_string(getPid());
+    else
+    if(name == "user")
+        value = getUserName();
+    else
+    if(name == "home")
+        value = getHome();
+    else
+    if(getSid() && name == "sid")
+        value = std::to_string(getSid());
+    else
+    if(getSid() && name == "session")
+        value = getSession();
+    else
+        return false;
+
+    return true;
+}
@@ -26,6 +26,7 @@
 #include <map>
 #include <list>
 #include <memory>
+#include <unordered_map>
 
 #include "plugins.h"
 #include "videowindow.h"
@@ -54,11 +55,21 @@ class MainScreen : public DisplayWindow
     std::list< std::unique_ptr<VideoWindow> > windows;
     std::list< std::unique_ptr<SignalPlugin> > signals;
     std::map< std::string, std::string > keymap;
+    std::unordered_map< std::string, std::list<VideoWindow*> > signalWindows;
 
     std::unique_ptr<FontRender> frs;
     std::unique_ptr<GalleryWindow> gallery;
 
+    std::unique_ptr<StoragePlugin> exportPlugin;
+    Surface             exportSurface;
+    Surface             exportBackground;
+    std::string         exportDateTime;
+    TickTrigger         ttExport;
+    u32                 exportPeriod;
+    bool                exportLayout;
+
     bool		showWindowPositionsDialog(const Window*, Rect &);
+    void                exportCompose(void);
 
 protected:
     bool		keyPressEvent(const KeySym &) override;
@@ -86,6 +97,7 @@ public:
     const std::string &	getSession(void) const { return session; }
 
     std::string         formatString(const std::string &) const;
+    bool                formatVariable(const std::string &, std::string &) const;
 };
 
 #endif
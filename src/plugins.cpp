@@ -20,7 +20,10 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#include <map>
+#include <mutex>
 #include <chrono>
+#include <random>
 #include <algorithm>
 
 #include "mainscreen.h"
@@ -54,6 +57,152 @@ const char* PluginValue::getName(int type)
     return "unknown";
 }
 
+/* PluginLibrary */
+namespace PluginLibrary
+{
+    std::mutex lock;
+    std::map<std::string, std::pair<void*, int>> libs;
+    std::map<std::string, std::string> found;
+}
+
+void* PluginLibrary::open(const std::string & file)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    auto it = libs.find(file);
+
+    if(it != libs.end())
+    {
+        (*it).second.second++;
+        return (*it).second.first;
+    }
+
+    // unlocked: other libraries opened in parallel
+    guard.unlock();
+
+    auto start = std::chrono::steady_clock::now();
+    void* lib = Systems::openLib(file);
+
+    if(! lib)
+        return nullptr;
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    guard.lock();
+
+    // the same file opened from other thread: one handle, loader refcounted
+    it = libs.find(file);
+
+    if(it != libs.end())
+    {
+        (*it).second.second++;
+        void* res = (*it).second.first;
+        guard.unlock();
+
+        Systems::closeLib(lib);
+        return res;
+    }
+
+    libs.emplace(file, std::make_pair(lib, 1));
+    guard.unlock();
+
+    StartupTimeline::mark(file, std::string("dlopen ").append(std::to_string(ms.count())).append("ms"));
+    return lib;
+}
+
+void PluginLibrary::close(void* lib)
+{
+    const std::lock_guard<std::mutex> guard(lock);
+    auto it = std::find_if(libs.begin(), libs.end(), [=](auto & pair){ return pair.second.first == lib; });
+
+    if(it == libs.end())
+    {
+        Systems::closeLib(lib);
+    }
+    else
+    if(0 == --(*it).second.second)
+    {
+        Systems::closeLib(lib);
+        libs.erase(it);
+    }
+}
+
+std::string PluginLibrary::find(const std::string & type)
+{
+    const std::lock_guard<std::mutex> guard(lock);
+    auto it = found.find(type);
+
+    if(it != found.end())
+        return (*it).second;
+
+    DEBUG("find plugin: " << type);
+    StringList dirs;
+
+#ifdef MULTI_CAPTURE_PLUGINS
+    dirs << Systems::concatePath(MULTI_CAPTURE_PLUGINS);
+#endif
+    dirs << Systems::concatePath(Application::getPath(), "plugins");
+
+    for(auto & dir : Systems::shareDirectories(Settings::programDomain()))
+        dirs << Systems::concatePath(dir, "plugins");
+
+    DEBUG("check plugin dirs: " << dirs.join(", "));
+    std::string res;
+
+    for(auto & dir : dirs)
+    {
+        std::string filename = Systems::concatePath(dir, type).append(Systems::suffixLib());
+        if(Systems::isFile(filename))
+        {
+            res = filename;
+            break;
+        }
+    }
+
+    // also not found
+    found.emplace(type, res);
+    return res;
+}
+
+/* StartupTimeline */
+namespace StartupTimeline
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::mutex lock;
+    std::list<std::string> events;
+    size_t expected = 0;
+    size_t frames = 0;
+    bool complete = false;
+}
+
+void StartupTimeline::expect(size_t sources)
+{
+    const std::lock_guard<std::mutex> guard(lock);
+    expected = sources;
+}
+
+void StartupTimeline::mark(const std::string & source, const std::string & event)
+{
+    const std::lock_guard<std::mutex> guard(lock);
+
+    // after first frame from all sources
+    if(complete)
+        return;
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    events.emplace_back(std::string("+").append(std::to_string(ms.count())).append("ms ").append(source).append(": ").append(event));
+    DEBUG("startup: " << events.back());
+
+    if(event == "first frame" && 0 < expected && ++frames >= expected)
+    {
+        VERBOSE("startup timeline, sources: " << expected << ", first frames: " << ms.count() << "ms");
+
+        for(auto & str : events)
+            VERBOSE("startup: " << str);
+
+        events.clear();
+        complete = true;
+    }
+}
+
 /* PluginParams */
 PluginParams::PluginParams(const JsonObject & jo)
 {
@@ -73,30 +222,10 @@ PluginParams::PluginParams(const JsonObject & jo)
     // find type.so
     if(type.size() && file.empty())
     {
-        DEBUG("find plugin: " << type);
-
-	StringList dirs;
+        file = PluginLibrary::find(type);
 
-#ifdef MULTI_CAPTURE_PLUGINS
-	dirs << Systems::concatePath(MULTI_CAPTURE_PLUGINS);
-#endif
-	dirs << Systems::concatePath(Application::getPath(), "plugins");
-
-	for(auto & dir : Systems::shareDirectories(Settings::programDomain()))
-	    dirs << Systems::concatePath(dir, "plugins");
-
-	DEBUG("check plugin dirs: " << dirs.join(", "));
-
-	for(auto & dir : dirs)
-	{
-	    std::string filename = Systems::concatePath(dir, type).append(Systems::suffixLib());
-	    if(Systems::isFile(filename))
-	    {
-		VERBOSE("plugin found: " << filename << ", plugin name: " << name);
-		file = filename;
-		break;
-	    }
-	}
+        if(file.size())
+            VERBOSE("plugin found: " << file << ", plugin name: " << name);
     }
 
     if(file.empty())
@@ -141,7 +270,7 @@ BasePlugin::BasePlugin(const PluginParams & params, Window & win) : PluginParams
     }
     else
     {
-        lib = Systems::openLib(file);
+        lib = PluginLibrary::open(file);
 
         if(lib)
         {
@@ -175,7 +304,7 @@ BasePlugin::~BasePlugin()
 	    data = nullptr;
 	}
 
-	Systems::closeLib(lib);
+	PluginLibrary::close(lib);
     }
 }
 
@@ -279,38 +408,128 @@ int BasePlugin::pluginType(void) const
 
 /* CapturePlugin */
 CapturePlugin::CapturePlugin(const PluginParams & params, Window & parent) : BasePlugin(params, parent),
-    scaleImage(false)
+    scaleImage(false), backoffMin(500), backoffMax(30000), attempts(0), reconnects(0), reconnectPending(false), downtime(0)
 {
     scaleImage = params.config.getBoolean("scale");
+    backoffMin = std::max(10, params.config.getInteger("reconnect:min", 500));
+    backoffMax = std::max(backoffMin, params.config.getInteger("reconnect:max", 30000));
 
     if(loadFunctions())
+        startSupervisor(false);
+}
+
+bool CapturePlugin::waitBackoff(size_t attempt) const
+{
+    thread_local std::minstd_rand gen(std::random_device{}());
+
+    // exponential with jitter 0.8 .. 1.2
+    int64_t delay = backoffMin;
+    for(size_t it = 1; it < attempt && delay < backoffMax; ++it)
+        delay *= 2;
+
+    delay = std::min(delay, int64_t(backoffMax));
+    delay = std::uniform_int_distribution<int64_t>(delay * 4 / 5, delay * 6 / 5)(gen);
+
+    DEBUG("capture reconnect: " << name << ", attempt: " << attempt << ", wait: " << delay << "ms");
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+
+    while(std::chrono::steady_clock::now() < end)
     {
-	thread = std::thread([this, win = & parent](){
-            if(this->data)
-	    {
-                this->fun_quit(this->data);
-		this->data = nullptr;
-	    }
+        if(threadExit)
+            return false;
 
-	    this->threadInitialize = false;
-            DEBUG("thread init start: " << this->name);
+        std::this_thread::sleep_for(20ms);
+    }
 
-	    while(! this->threadExit)
-	    {
-	        if(nullptr != (this->data = this->fun_init(this->config)))
+    return ! threadExit;
+}
+
+void CapturePlugin::startSupervisor(bool restart)
+{
+    thread = std::thread([this, win = parent, restart](){
+        auto start = std::chrono::steady_clock::now();
+
+        if(this->data)
+        {
+            this->fun_quit(this->data);
+            this->data = nullptr;
+        }
+
+        this->threadInitialize = false;
+        DEBUG("thread init start: " << this->name);
+
+        // flapping source: delay before reconnect
+        if(restart && 0 < this->attempts && ! this->waitBackoff(this->attempts))
+            return;
+
+        while(! this->threadExit)
+        {
+            if(nullptr != (this->data = this->fun_init(this->config)))
+            {
+                this->fun_set_value(this->data, PluginValue::InitGui, win);
+                this->initPoint = std::chrono::steady_clock::now();
+                this->threadInitialize = true;
+                DEBUG("thread init complete: " << this->name);
+
+                if(restart)
                 {
-                    this->fun_set_value(this->data, PluginValue::InitGui, win);
-		    this->threadInitialize = true;
-                    DEBUG("thread init complete: " << this->name);
-		    break;
-	        }
+                    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(this->initPoint - start);
+                    this->downtime += ms;
+                    this->attempts++;
+
+                    VERBOSE("capture reconnected: " << this->name << ", count: " << this->reconnects <<
+                        ", duration: " << ms.count() << "ms" << ", downtime: " << this->downtime.count() << "ms");
+                }
+                else
+                {
+                    StartupTimeline::mark(this->name, "init");
+                }
 
-                // free res
-                ERROR("thread init broken: " << this->name);
-                std::this_thread::sleep_for(3000ms);
-	    }
-        });
+                // reset requested while init: repeat from gui thread
+                if(this->reconnectPending.exchange(false))
+                    DisplayScene::pushEvent(nullptr, ActionCaptureReset, this->data);
+                break;
+            }
+
+            // free res
+            ERROR("thread init broken: " << this->name);
+
+            if(! this->waitBackoff(++this->attempts))
+                break;
+        }
+    });
+}
+
+bool CapturePlugin::reconnect(void)
+{
+    // init or reconnect in progress: the supervisor repeats it after init
+    if(! threadInitialize)
+    {
+        reconnectPending = true;
+
+        // init complete meanwhile: take the request back, if not taken by the supervisor
+        if(! threadInitialize || ! reconnectPending.exchange(false))
+        {
+            DEBUG("capture reconnect pending: " << name);
+            return false;
+        }
     }
+
+    // init thread complete
+    if(thread.joinable())
+        thread.join();
+
+    // stable after last reconnect: reset backoff
+    if(std::chrono::steady_clock::now() - initPoint > 60s)
+        attempts = 0;
+
+    threadInitialize = false;
+    reconnectPending = false;
+    reconnects++;
+
+    // library loaded, quit and init from supervisor thread
+    startSupervisor(true);
+    return true;
 }
 
 CapturePlugin::~CapturePlugin()
@@ -351,38 +570,13 @@ const Surface & CapturePlugin::getSurface(void)
 
 /* StoragePlugin */
 StoragePlugin::StoragePlugin(const PluginParams & params, Window & parent) : BasePlugin(params, parent),
-    tickPeriod(0), fun_store_action(nullptr)
+    tickPeriod(0), actionsLimit(4), surfaceChanged(false), sessionChanged(false), fun_store_action(nullptr)
 {
     signals = params.config.getStdList<std::string>("signals");
+    actionsLimit = std::max(1, params.config.getInteger("action:queue", 4));
 
     if(loadFunctions())
-    {
-	thread = std::thread([this, win = & parent](){
-            if(this->data)
-	    {
-                this->fun_quit(this->data);
-		this->data = nullptr;
-	    }
-
-            this->threadInitialize = false;
-            DEBUG("thread init start: " << this->name);
-
-	    while(! this->threadExit)
-	    {
-	        if(nullptr != (this->data = this->fun_init(this->config)))
-                {
-                    this->fun_set_value(this->data, PluginValue::InitGui, win);
-		    this->threadInitialize = true;
-                    DEBUG("thread init complete: " << this->name);
-		    break;
-	        }
-
-                // free res
-                ERROR("thread init broken: " << this->name);
-                std::this_thread::sleep_for(3000ms);
-	    }
-        });
-    }
+	thread = std::thread(& StoragePlugin::workerLoop, this, & parent);
 
     std::string signal = findSignal("tick:", false);
     if(signal.size())
@@ -394,7 +588,118 @@ StoragePlugin::StoragePlugin(const PluginParams & params, Window & parent) : Bas
 
 StoragePlugin::~StoragePlugin()
 {
-    joinThread();
+    if(true)
+    {
+        const std::lock_guard<std::mutex> lock(queueLock);
+        threadExit = true;
+        queueCond.notify_all();
+    }
+
+    if(thread.joinable())
+    {
+        DEBUG("wait thread: " << name);
+        thread.join();
+    }
+}
+
+void StoragePlugin::workerLoop(Window* win)
+{
+    threadInitialize = false;
+    DEBUG("thread init start: " << name);
+
+    while(! threadExit)
+    {
+        if(nullptr != (data = fun_init(config)))
+        {
+            fun_set_value(data, PluginValue::InitGui, win);
+            threadInitialize = true;
+            DEBUG("thread init complete: " << name);
+            StartupTimeline::mark(name, "init");
+            break;
+        }
+
+        // free res
+        ERROR("thread init broken: " << name);
+
+        std::unique_lock<std::mutex> lock(queueLock);
+        queueCond.wait_for(lock, 3000ms, [this]{ return this->threadExit.load(); });
+    }
+
+    // actions loop: queued actions completed before exit
+    while(threadInitialize)
+    {
+        std::string signal;
+        Surface surface;
+        SessionIdName session;
+        bool surfaceSet = false;
+        bool sessionSet = false;
+
+        if(true)
+        {
+            std::unique_lock<std::mutex> lock(queueLock);
+            queueCond.wait(lock, [this]{ return this->threadExit || this->surfaceChanged || this->sessionChanged || ! this->actions.empty(); });
+
+            if(threadExit && actions.empty())
+                break;
+
+            // the last surface only
+            if(surfaceChanged)
+            {
+                std::swap(surface, surfaceNext);
+                surfaceChanged = false;
+                surfaceSet = true;
+            }
+
+            if(sessionChanged)
+            {
+                session = sessionNext;
+                sessionChanged = false;
+                sessionSet = true;
+            }
+
+            if(! actions.empty())
+            {
+                signal = actions.front();
+                // keep in queue for double signal check
+            }
+        }
+
+        if(sessionSet)
+        {
+            fun_set_value(data, PluginValue::SessionId, & session.id);
+            fun_set_value(data, PluginValue::SessionName, & session.name);
+        }
+
+        if(surfaceSet)
+            fun_set_value(data, PluginValue::StorageSurface, & surface);
+
+        if(signal.empty())
+            continue;
+
+        int err = fun_store_action(data, signal);
+        threadResult = err;
+
+        if(PluginResult::DefaultOk == err)
+        {
+            Surface surf;
+            std::string label;
+
+            if(fun_get_value(data, PluginValue::StorageLocation, & label) &&
+                fun_get_value(data, PluginValue::StorageSurface, & surf))
+            {
+                const std::lock_guard<std::mutex> lock(queueLock);
+                storedLast = SurfaceLabel(surf, label);
+            }
+
+            DisplayScene::pushEvent(nullptr, ActionPushGallery, this);
+        }
+        else
+        if(PluginResult::Reset == err)
+            DisplayScene::pushEvent(nullptr, ActionStorageReset, this);
+
+        const std::lock_guard<std::mutex> lock(queueLock);
+        actions.pop_front();
+    }
 }
 
 bool StoragePlugin::loadFunctions(void)
@@ -424,39 +729,31 @@ bool StoragePlugin::isTickEvent(u32 ms) const
 
 void StoragePlugin::sessionReset(const SessionIdName & ss)
 {
-    fun_set_value(data, PluginValue::SessionId, & ss.id);
-    fun_set_value(data, PluginValue::SessionName, & ss.name);
+    const std::lock_guard<std::mutex> lock(queueLock);
+
+    sessionNext = ss;
+    sessionChanged = true;
+    queueCond.notify_one();
 }
 
 int StoragePlugin::storeAction(const std::string & signal)
 {
     if(threadInitialize && fun_store_action && data)
     {
-        if(threadAction && threadSignal == signal)
-        {
-            // skip fast double signal
-            // wait action complete
-            return 0;
-        }
+        const std::lock_guard<std::mutex> lock(queueLock);
 
-        threadAction = true;
-        threadSignal = signal;
-
-        //DEBUG("thread action start: " << name);
-	if(thread.joinable())
-	    thread.join();
+        // skip fast double signal
+        if(actions.end() != std::find(actions.begin(), actions.end(), signal))
+            return 0;
 
-        thread = std::thread([this, sig = signal](){
-            int err = this->fun_store_action(this->data, sig);
-            if(PluginResult::DefaultOk == err)
-                DisplayScene::pushEvent(nullptr, ActionPushGallery, this);
-            else
-            if(PluginResult::Reset == err)
-                DisplayScene::pushEvent(nullptr, ActionStorageReset, this);
+        if(actionsLimit <= actions.size())
+        {
+            ERROR("action queue full: " << name << ", skip signal: " << signal);
+            return 1;
+        }
 
-            this->threadAction = false;
-            this->threadResult = err;
-        });
+        actions.push_back(signal);
+        queueCond.notify_one();
 
         return 0;
     }
@@ -468,38 +765,20 @@ void StoragePlugin::setSurface(const Surface & sf)
 {
     if(threadInitialize && fun_set_value && data)
     {
-	if(threadAction)
-	{
-    	    if(thread.joinable())
-                thread.join();
+        // handoff to worker, the not processed surface replaced
+        const std::lock_guard<std::mutex> lock(queueLock);
 
-            threadAction = false;
-	}
-
-	fun_set_value(data, PluginValue::StorageSurface, & sf);
+        surfaceNext = sf;
+        surfaceChanged = true;
+        queueCond.notify_one();
     }
 }
 
 SurfaceLabel StoragePlugin::getSurfaceLabel(void)
 {
-    if(threadInitialize)
-    {
-	if(threadAction)
-	{
-    	    if(thread.joinable())
-                thread.join();
-            threadAction = false;
-	}
-
-        Surface surf;
-        std::string label;
-
-        if(fun_get_value(data, PluginValue::StorageLocation, & label) &&
-            fun_get_value(data, PluginValue::StorageSurface, & surf))
-	    return SurfaceLabel(surf, label);
-    }
-
-    return SurfaceLabel();
+    // the last stored from worker
+    const std::lock_guard<std::mutex> lock(queueLock);
+    return storedLast;
 }
 
 std::string StoragePlugin::findSignal(const std::string & str, bool strong) const
@@ -545,6 +824,7 @@ SignalPlugin::SignalPlugin(const PluginParams & params, Window & parent)
                     this->fun_set_value(this->data, PluginValue::InitGui, win);
 		    this->threadInitialize = true;
                     DEBUG("thread init complete: " << this->name);
+                    StartupTimeline::mark(this->name, "init");
 		    break;
 	        }
 
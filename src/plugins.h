@@ -33,13 +33,31 @@
 #include <dlfcn.h>
 #endif
 
+#include <list>
+#include <mutex>
 #include <atomic>
+#include <chrono>
 #include <thread>
+#include <condition_variable>
 
 #include "settings.h"
 
 enum { PluginReturnTrue = 0, PluginReturnFalse = -1, PluginReturnClose = -2 };
 
+namespace PluginLibrary
+{
+    // shared library handles, one per file
+    void*               open(const std::string & file);
+    void                close(void* lib);
+    std::string         find(const std::string & type);
+}
+
+namespace StartupTimeline
+{
+    void                expect(size_t sources);
+    void                mark(const std::string & source, const std::string & event);
+}
+
 struct SurfaceLabel : std::pair<Surface, std::string>
 {
     SurfaceLabel(const Surface sf, const std::string & lb) : std::pair<Surface, std::string>(sf, lb) {}
@@ -108,6 +126,18 @@ class CapturePlugin : public BasePlugin
 
     bool                scaleImage;
 
+    // reconnect supervisor
+    int                 backoffMin;
+    int                 backoffMax;
+    size_t              attempts;
+    std::atomic<size_t> reconnects;
+    std::atomic<bool>   reconnectPending;
+    std::chrono::milliseconds downtime;
+    std::chrono::steady_clock::time_point initPoint;
+
+    void                startSupervisor(bool restart);
+    bool                waitBackoff(size_t attempt) const;
+
 protected:
     bool                loadFunctions(void);
 
@@ -117,6 +147,9 @@ public:
 
     const Surface &     getSurface(void);
     bool		isScaleImage(void) const;
+
+    bool                reconnect(void);
+    size_t              reconnectCount(void) const { return reconnects; }
 };
 
 class StoragePlugin : public BasePlugin
@@ -125,7 +158,19 @@ class StoragePlugin : public BasePlugin
 
     TickTrigger		ttStorage;
     int                 tickPeriod;
-    std::string         threadSignal;
+
+    // worker: bounded actions queue, last surface and session
+    std::mutex          queueLock;
+    std::condition_variable queueCond;
+    std::list<std::string> actions;
+    size_t              actionsLimit;
+    Surface             surfaceNext;
+    bool                surfaceChanged;
+    SessionIdName       sessionNext;
+    bool                sessionChanged;
+    SurfaceLabel        storedLast;
+
+    void                workerLoop(Window*);
 
 protected:
     int			(*fun_store_action) (void*, const std::string &);
@@ -141,6 +186,7 @@ public:
     void		sessionReset(const SessionIdName &);
 
     std::string		findSignal(const std::string &, bool strong) const;
+    const StringList &  signalNames(void) const { return signals; }
     SurfaceLabel	getSurfaceLabel(void);
     bool		isTickEvent(u32 ms) const;
 };
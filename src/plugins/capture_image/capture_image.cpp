@@ -23,6 +23,16 @@
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
 #include "../../settings.h"
 
 #ifdef __cplusplus
@@ -30,7 +40,7 @@ extern "C" {
 #endif
 
 using namespace std::chrono_literals;
-const int capture_image_version = 20220412;
+const int capture_image_version = 20220418;
 
 struct capture_image_t
 {
@@ -67,6 +77,111 @@ struct capture_image_t
 	fileImage.clear();
     }
 
+    static std::string fileStamp(const std::string & file)
+    {
+        struct stat st;
+        if(0 != stat(file.c_str(), & st) || ! S_ISREG(st.st_mode))
+            return std::string();
+
+        // inode, size and mtime: changed also by atomic rename
+#if defined(__linux__)
+        return std::to_string(st.st_ino).append(":").append(std::to_string(st.st_size)).append(":").
+            append(std::to_string(st.st_mtim.tv_sec)).append(".").append(std::to_string(st.st_mtim.tv_nsec));
+#else
+        return std::to_string(st.st_ino).append(":").append(std::to_string(st.st_size)).append(":").
+            append(std::to_string(st.st_mtime));
+#endif
+    }
+
+    int watchInit(void)
+    {
+#if defined(__linux__)
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(0 > fd)
+        {
+            ERROR("inotify init failed, error: " << strerror(errno) << ", used polling");
+            return fd;
+        }
+
+        std::list<std::string> dirs = { Systems::dirname(fileImage) };
+        if(! fileLock.empty())
+            dirs.push_back(Systems::dirname(fileLock));
+        dirs.unique();
+
+        for(auto & dir : dirs)
+        {
+            if(0 > inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE))
+            {
+                ERROR("inotify watch failed, dir: " << dir << ", error: " << strerror(errno) << ", used polling");
+                close(fd);
+                return -1;
+            }
+
+            if(debug) DEBUG("inotify watch: " << dir);
+        }
+
+        return fd;
+#else
+        return -1;
+#endif
+    }
+
+    // wait inotify events, return false if timeout
+    bool watchWait(int fd, int timeout, const std::string & nameImage, const std::string & nameLock, bool & locked, bool & changed)
+    {
+#if defined(__linux__)
+        struct pollfd pfd = { fd, POLLIN, 0 };
+
+        if(0 >= poll(& pfd, 1, timeout))
+            return false;
+
+        alignas(struct inotify_event) char buf[4096];
+        ssize_t len = 0;
+
+        while(0 < (len = read(fd, buf, sizeof(buf))))
+        {
+            for(char* ptr = buf; ptr < buf + len; )
+            {
+                auto ev = reinterpret_cast<const struct inotify_event*>(ptr);
+                ptr += sizeof(struct inotify_event) + ev->len;
+
+                if(ev->mask & IN_Q_OVERFLOW)
+                {
+                    locked = ! fileLock.empty() && Systems::isFile(fileLock);
+                    changed = true;
+                    continue;
+                }
+
+                if(0 == ev->len)
+                    continue;
+
+                if(nameLock == ev->name)
+                {
+                    if(ev->mask & (IN_CREATE | IN_MOVED_TO))
+                        locked = true;
+                    else
+                    if(ev->mask & (IN_DELETE | IN_MOVED_FROM))
+                    {
+                        locked = false;
+                        // missed image events while locked
+                        changed = true;
+                    }
+
+                    if(3 < debug)
+                        DEBUG("lock file: " << (locked ? "created" : "removed"));
+                }
+                else
+                if(nameImage == ev->name && (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)))
+                    changed = true;
+            }
+        }
+
+        return true;
+#else
+        return false;
+#endif
+    }
+
     void start(void)
     {
         shutdown = false;
@@ -74,64 +189,98 @@ struct capture_image_t
         // frames loop
         thread = std::thread([st = this]
         {
-            Surface frame;
-            size_t duration = 1000/st->framesPerSec;
-            auto point = std::chrono::steady_clock::now();
-    
+            const std::string nameImage = Systems::basename(st->fileImage);
+            const std::string nameLock = st->fileLock.empty() ? "" : Systems::basename(st->fileLock);
+            const std::chrono::milliseconds duration(1000/st->framesPerSec);
+
+            // without inotify: stat polling every frame duration
+            int fd = st->watchInit();
+
+            // the watch is set first, the events after this check are not lost
+            bool locked = ! st->fileLock.empty() && Systems::isFile(st->fileLock);
+            bool changed = true;
+            std::string stamp;
+            auto point = std::chrono::steady_clock::now() - duration;
+
             while(! st->shutdown)
             {
-                if(5 < st->frames.size())
+                auto now = std::chrono::steady_clock::now();
+                // limit fps
+                auto delay = point + duration - now;
+                int timeout = -1;
+
+                if(changed && ! locked)
+                    timeout = 0 < delay.count() ? std::chrono::duration_cast<std::chrono::milliseconds>(delay).count() + 1 : 0;
+
+                if(0 > fd)
+                    timeout = duration.count();
+
+                // the idle wait: shutdown check only
+                if(0 > timeout || 100 < timeout)
+                    timeout = 100;
+
+                if(0 <= fd)
                 {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(duration));
-                    point = std::chrono::steady_clock::now();
-                    continue;
+                    st->watchWait(fd, timeout, nameImage, nameLock, locked, changed);
                 }
-        
-                if(! st->fileLock.empty() && Systems::isFile(st->fileLock))
+                else
                 {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-	            continue;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+                    locked = ! st->fileLock.empty() && Systems::isFile(st->fileLock);
+                    changed = true;
                 }
 
-                auto now = std::chrono::steady_clock::now();
-                auto timeMS = std::chrono::duration_cast<std::chrono::milliseconds>(now - point);
+                if(! changed || locked)
+                    continue;
 
-                // limit fps
-                if(timeMS < std::chrono::milliseconds(duration))
+                now = std::chrono::steady_clock::now();
+                if(now < point + duration)
+                    continue;
+
+                if(5 < st->frames.size())
                 {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    point = now;
                     continue;
                 }
 
-                if(3 < st->debug)
+                changed = false;
+                point = now;
+
+                // skip decoding: image not changed
+                auto current = fileStamp(st->fileImage);
+                if(current.empty())
                 {
-                    DEBUG("calculate fps: " << 1000 / timeMS.count() << "fps");
+                    if(3 < st->debug)
+                        ERROR("file not found: " << st->fileImage);
+                    stamp.clear();
+                    continue;
                 }
 
-                if(Systems::isFile(st->fileImage))
-                {
-	            Surface frame(st->fileImage);
+                if(current == stamp)
+                    continue;
 
-	            if(! frame.isValid())
-                    {
-	                ERROR("unknown image format, file: " << st->fileImage);
-                        std::this_thread::sleep_for(std::chrono::milliseconds(300));
-                        point = std::chrono::steady_clock::now();
-                        continue;
-                    }
-                    
-                    st->frames.push_back(frame);
-                    DisplayScene::pushEvent(nullptr, ActionFrameComplete, st);
-                    point = now;
-                }
-                else
-                if(3 < st->debug)
+                Surface frame(st->fileImage);
+
+                if(! frame.isValid())
                 {
-	            ERROR("file not found: " << st->fileImage);
+                    // partially written without lock, retry on next event
+                    ERROR("unknown image format, file: " << st->fileImage);
+                    continue;
                 }
 
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                stamp = current;
+
+                if(3 < st->debug)
+                    DEBUG("image reloaded: " << st->fileImage);
+
+                st->frames.push_back(frame);
+                DisplayScene::pushEvent(nullptr, ActionFrameComplete, st);
             }
+
+#if defined(__linux__)
+            if(0 <= fd)
+                close(fd);
+#endif
         });
     }
 };
@@ -25,8 +25,15 @@
 #include <thread>
 #include <chrono>
 #include <cstdio>
+#include <cctype>
+#include <cstring>
 #include <memory>
 #include <iterator>
+#include <algorithm>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "../../settings.h"
 
@@ -35,7 +42,9 @@ extern "C" {
 #endif
 
 using namespace std::chrono_literals;
-const int capture_script_version = 20220412;
+const int capture_script_version = 20220419;
+
+enum class StreamFormat { None, Path, PPM };
 
 struct capture_script_t
 {
@@ -49,7 +58,13 @@ struct capture_script_t
     Frames             frames;
     std::array<char, 1024> buffer;
 
-    capture_script_t() : debug(0), unlink(false), framesPerSec(25), shutdown(false)
+    StreamFormat       stream;
+    int                streamFd;
+    pid_t              streamPid;
+    std::vector<uint8_t> streamBuf;
+
+    capture_script_t() : debug(0), unlink(false), framesPerSec(25), shutdown(false),
+        stream(StreamFormat::None), streamFd(-1), streamPid(-1)
     {
     }
 
@@ -64,9 +79,12 @@ struct capture_script_t
         if(thread.joinable())
             thread.join();
 
+        streamStop();
+
         debug = 0;
         unlink = false;
         framesPerSec = 25;
+        stream = StreamFormat::None;
 
         frames.clear();
         command.clear();
@@ -92,6 +110,274 @@ struct capture_script_t
         return fileImage;
     }
 
+    bool streamStart(void)
+    {
+        int fds[2];
+
+        if(0 > pipe2(fds, O_CLOEXEC))
+        {
+            ERROR("pipe failed, error: " << strerror(errno));
+            return false;
+        }
+
+        streamPid = Coprocess::spawn(command, -1, fds[1]);
+
+        if(0 > streamPid)
+        {
+            ERROR("fork failed, error: " << strerror(errno));
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+
+        close(fds[1]);
+        streamFd = fds[0];
+        streamBuf.clear();
+
+        if(debug) DEBUG("coprocess started, pid: " << streamPid);
+        return true;
+    }
+
+    void streamStop(void)
+    {
+        if(0 <= streamFd)
+        {
+            close(streamFd);
+            streamFd = -1;
+        }
+
+        if(0 < streamPid)
+        {
+            Coprocess::terminate(streamPid);
+            streamPid = -1;
+        }
+    }
+
+    // return: -1 eof or error, 0 timeout, or bytes read
+    ssize_t streamRead(int timeout)
+    {
+        struct pollfd pfd = { streamFd, POLLIN, 0 };
+
+        int res = poll(& pfd, 1, timeout);
+        if(0 >= res)
+            return 0 > res && errno != EINTR ? -1 : 0;
+
+        const size_t pos = streamBuf.size();
+        streamBuf.resize(pos + 65536);
+
+        ssize_t len = read(streamFd, streamBuf.data() + pos, 65536);
+        streamBuf.resize(pos + std::max(len, ssize_t(0)));
+
+        if(0 > len && (errno == EINTR || errno == EAGAIN))
+            return 0;
+
+        return 0 < len ? len : -1;
+    }
+
+    // ppm header: P6 <width> <height> <maxval> and single whitespace
+    // return: -1 invalid, 0 need more data, or header length
+    static ssize_t parseHeaderPPM(const std::vector<uint8_t> & buf, int & width, int & height)
+    {
+        std::array<int, 3> vals = { 0, 0, 0 };
+        size_t pos = 2;
+
+        if(buf.size() < 2)
+            return 0;
+
+        if(buf[0] != 'P' || buf[1] != '6')
+            return -1;
+
+        for(auto & val : vals)
+        {
+            // skip whitespace and comments
+            while(pos < buf.size())
+            {
+                if(buf[pos] == '#')
+                {
+                    while(pos < buf.size() && buf[pos] != '\n') pos++;
+                }
+                else
+                if(std::isspace(buf[pos]))
+                    pos++;
+                else
+                    break;
+            }
+
+            if(pos >= buf.size())
+                return 0;
+
+            if(! std::isdigit(buf[pos]))
+                return -1;
+
+            while(pos < buf.size() && std::isdigit(buf[pos]))
+            {
+                val = val * 10 + (buf[pos] - '0');
+                if(65535 < val)
+                    return -1;
+                pos++;
+            }
+
+            if(pos >= buf.size())
+                return 0;
+        }
+
+        if(! std::isspace(buf[pos]))
+            return -1;
+
+        // 8 bit only, 8k limit
+        if(0 == vals[0] || 0 == vals[1] || 8192 < vals[0] || 8192 < vals[1] || 255 != vals[2])
+            return -1;
+
+        width = vals[0];
+        height = vals[1];
+
+        return pos + 1;
+    }
+
+    // return: -1 stream error, 0 need more data, or 1 frame complete
+    // skip: queue is full, do not decode a path if a newer one is buffered
+    int streamFrame(Surface & frame, bool skip)
+    {
+        if(stream == StreamFormat::Path)
+        {
+            auto it = std::find(streamBuf.begin(), streamBuf.end(), '\n');
+            if(it == streamBuf.end())
+                return 0;
+
+            std::string fileImage(streamBuf.begin(), it);
+            bool newer = std::find(std::next(it), streamBuf.end(), '\n') != streamBuf.end();
+            streamBuf.erase(streamBuf.begin(), std::next(it));
+
+            if(3 < debug)
+                DEBUG("command result image: " << fileImage);
+
+            if(skip && newer)
+            {
+                if(unlink && Systems::isFile(fileImage))
+                    Systems::remove(fileImage);
+                frame.reset();
+                return 1;
+            }
+
+            if(! Systems::isFile(fileImage))
+            {
+                if(3 < debug)
+                    ERROR("file not found: " << fileImage);
+                return 1;
+            }
+
+            frame = Surface(fileImage);
+
+            if(! frame.isValid())
+                ERROR("unknown image format, file: " << fileImage);
+
+            if(unlink)
+                Systems::remove(fileImage);
+
+            return 1;
+        }
+
+        int width = 0;
+        int height = 0;
+
+        auto headerLen = parseHeaderPPM(streamBuf, width, height);
+        if(0 > headerLen)
+        {
+            ERROR("ppm stream: invalid header");
+            return -1;
+        }
+
+        const size_t frameLen = headerLen + width * height * 3;
+        if(0 == headerLen || streamBuf.size() < frameLen)
+            return 0;
+
+        // SDL_PIXELFORMAT_RGB24
+        uint32_t rmask = 0x00FF0000; uint32_t gmask = 0x0000FF00; uint32_t bmask = 0x000000FF;
+#if (__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__)
+        std::swap(rmask, bmask);
+#endif
+
+        SDL_Surface* sf = SDL_CreateRGBSurfaceFrom(streamBuf.data() + headerLen, width, height,
+                            24, width * 3, rmask, gmask, bmask, 0);
+
+        if(sf)
+            frame = Surface::copy(sf);
+
+        streamBuf.erase(streamBuf.begin(), streamBuf.begin() + frameLen);
+        return 1;
+    }
+
+    void startStream(void)
+    {
+        shutdown = false;
+
+        // coprocess loop
+        thread = std::thread([st = this]
+        {
+            // first start without delay
+            auto point = std::chrono::steady_clock::now() - 1s;
+            size_t dropped = 0;
+
+            while(! st->shutdown)
+            {
+                if(0 > st->streamFd)
+                {
+                    // restart delay
+                    if(std::chrono::steady_clock::now() - point < 1s)
+                    {
+                        std::this_thread::sleep_for(100ms);
+                        continue;
+                    }
+
+                    point = std::chrono::steady_clock::now();
+
+                    if(! st->streamStart())
+                        continue;
+                }
+
+                auto res = st->streamRead(100);
+
+                if(0 > res)
+                {
+                    ERROR("coprocess stream closed, command: " << st->command);
+                    st->streamStop();
+                    continue;
+                }
+
+                if(0 == res)
+                    continue;
+
+                Surface frame;
+                int status = 0;
+
+                while(0 < (status = st->streamFrame(frame, 5 < st->frames.size())))
+                {
+                    if(! frame.isValid())
+                        continue;
+
+                    // the script sets the rate, the newest frame replaces the last queued
+                    if(st->frames.push_back(frame, 6))
+                    {
+                        DisplayScene::pushEvent(nullptr, ActionFrameComplete, st);
+                    }
+                    else
+                    {
+                        dropped++;
+                        if(3 < st->debug)
+                            DEBUG("frames queue full, dropped: " << dropped);
+                    }
+
+                    frame.reset();
+                }
+
+                if(0 > status)
+                    st->streamStop();
+            }
+
+            st->streamStop();
+        });
+    }
+
     void start(void)
     {
         shutdown = false;
@@ -190,10 +476,25 @@ void* capture_script_init(const JsonObject & config)
         return nullptr;
     }
 
+    auto stream = config.getString("stream");
+
+    if(stream == "path")
+        ptr->stream = StreamFormat::Path;
+    else
+    if(stream == "ppm")
+        ptr->stream = StreamFormat::PPM;
+    else
+    if(stream.size())
+        ERROR("stream param unknown: " << stream << ", used exec per frame");
+
     DEBUG("params: " << "frames:sec = " << ptr->framesPerSec);
     DEBUG("params: " << "exec = " << ptr->command);
+    DEBUG("params: " << "stream = " << (stream.size() ? stream : "none"));
 
-    ptr->start();
+    if(ptr->stream != StreamFormat::None)
+        ptr->startStream();
+    else
+        ptr->start();
 
     return ptr.release();
 }
@@ -0,0 +1,268 @@
+/***************************************************************************
+ *   Copyright (C) 2022 by MultiCapture team <public.irkutsk@gmail.com>    *
+ *                                                                         *
+ *   Part of the MultiCapture engine:                                      *
+ *   https://github.com/AndreyBarmaley/multi-capture                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+
+#include "../../settings.h"
+#include "shm_frames.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+using namespace std::chrono_literals;
+const int capture_shm_version = 20220412;
+
+struct capture_shm_t
+{
+    int                debug;
+    std::string        name;
+
+    std::thread        thread;
+    std::atomic<bool>  shutdown;
+    Frames             frames;
+    ShmFrames::Ring    ring;
+
+    capture_shm_t() : debug(0), shutdown(false)
+    {
+    }
+
+    ~capture_shm_t()
+    {
+	clear();
+    }
+
+    void clear(void)
+    {
+        shutdown = true;
+        if(thread.joinable())
+            thread.join();
+
+        debug = 0;
+        ring.close();
+        frames.clear();
+        name.clear();
+    }
+
+    void start(void)
+    {
+        shutdown = false;
+
+        // frames loop
+        thread = std::thread([st = this]
+        {
+            uint64_t seen = 0;
+            bool waitNotify = true;
+            auto idle = std::chrono::steady_clock::now();
+
+            while(! st->shutdown)
+            {
+                if(! st->ring.isOpen())
+                {
+                    if(! st->ring.open(st->name))
+                    {
+                        if(waitNotify)
+                        {
+                            DEBUG("wait shared memory: " << st->name);
+                            waitNotify = false;
+                        }
+
+                        std::this_thread::sleep_for(500ms);
+                        continue;
+                    }
+
+                    if(st->debug)
+                        DEBUG("shared memory opened: " << st->name << ", slots: " << st->ring.header()->slots);
+
+                    // start from the last frame
+                    seen = st->ring.sequence();
+                    seen = seen ? seen - 1 : 0;
+                    waitNotify = true;
+                    idle = std::chrono::steady_clock::now();
+                }
+
+                if(! st->ring.waitFrame(seen, 100))
+                {
+                    // producer restarted: segment replaced
+                    if(2s < std::chrono::steady_clock::now() - idle && st->ring.isReplaced())
+                    {
+                        if(st->debug)
+                            DEBUG("shared memory replaced: " << st->name);
+
+                        st->ring.close();
+                    }
+
+                    continue;
+                }
+
+                idle = std::chrono::steady_clock::now();
+                seen = st->ring.sequence();
+
+                Surface frame;
+                bool valid = st->ring.readFrame(seen, [&](const ShmFrames::FrameHeader & fh, const uint8_t* pixels)
+                {
+                    SDL_Surface* sf = SDL_CreateRGBSurfaceFrom(const_cast<uint8_t*>(pixels), fh.width, fh.height,
+                                            fh.bitsPerPixel, fh.pitch, fh.rmask, fh.gmask, fh.bmask, fh.amask);
+
+                    if(sf)
+                        frame = Surface::copy(sf);
+                });
+
+                if(valid && frame.isValid())
+                {
+                    // display is slow: the newest frame replaces the last queued
+                    if(st->frames.push_back(frame, 3))
+                        DisplayScene::pushEvent(nullptr, ActionFrameComplete, st);
+                }
+                else
+                if(2 < st->debug)
+                {
+                    DEBUG("frame skipped, sequence: " << seen);
+                }
+            }
+        });
+    }
+};
+
+void* capture_shm_init(const JsonObject & config)
+{
+    VERBOSE("version: " << capture_shm_version);
+
+    auto ptr = std::make_unique<capture_shm_t>();
+
+    ptr->debug = config.getInteger("debug", 0);
+    ptr->name = config.getString("name");
+
+    if(ptr->name.empty())
+    {
+        ERROR("name param empty");
+        ptr->clear();
+        return nullptr;
+    }
+
+    // posix shm name
+    if(ptr->name.front() != '/')
+        ptr->name.insert(0, "/");
+
+    DEBUG("params: " << "name = " << ptr->name);
+
+    ptr->start();
+
+    return ptr.release();
+}
+
+void capture_shm_quit(void* ptr)
+{
+    capture_shm_t* st = static_cast<capture_shm_t*>(ptr);
+    if(st->debug) DEBUG("version: " << capture_shm_version);
+
+    delete st;
+}
+
+bool capture_shm_get_value(void* ptr, int type, void* val)
+{
+    switch(type)
+    {
+        case PluginValue::PluginName:
+            if(auto res = static_cast<std::string*>(val))
+            {
+                res->assign("capture_shm");
+                return true;
+            }
+            break;
+    
+        case PluginValue::PluginVersion:
+            if(auto res = static_cast<int*>(val))
+            {
+                *res = capture_shm_version;
+                return true;
+            }
+            break;
+
+        case PluginValue::PluginAPI:
+            if(auto res = static_cast<int*>(val))
+            {
+                *res = PLUGIN_API;
+                return true;
+            }
+            break;
+
+        case PluginValue::PluginType:
+            if(auto res = static_cast<int*>(val))
+            {
+                *res = PluginType::Capture;
+                return true;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if(ptr)
+    {
+        capture_shm_t* st = static_cast<capture_shm_t*>(ptr);
+        if(4 < st->debug)
+            DEBUG("version: " << capture_shm_version << ", type: " << type);
+    
+        switch(type)
+        {
+            case PluginValue::CaptureSurface:
+                if(auto res = static_cast<Surface*>(val))
+                {
+                    if(! st->frames.empty())
+                    {
+                        res->setSurface(st->frames.front());
+                        st->frames.pop_front();
+                        return true;
+                    }
+                    return false;
+                }
+                break;
+
+            default: break;
+        }
+    }
+
+    return false;
+}
+
+bool capture_shm_set_value(void* ptr, int type, const void* val)
+{
+    capture_shm_t* st = static_cast<capture_shm_t*>(ptr);
+    if(4 < st->debug)
+        DEBUG("version: " << capture_shm_version << ", type: " << type);
+
+    switch(type)
+    {
+        default: break;
+    }
+
+    return false;
+}
+
+#ifdef __cplusplus
+}
+#endif
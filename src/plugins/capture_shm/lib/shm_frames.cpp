@@ -0,0 +1,278 @@
+/***************************************************************************
+ *   Copyright (C) 2022 by MultiCapture team <public.irkutsk@gmail.com>    *
+ *                                                                         *
+ *   Part of the MultiCapture engine:                                      *
+ *   https://github.com/AndreyBarmaley/multi-capture                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include "libswe.h"
+#include "shm_frames.h"
+
+namespace ShmFrames
+{
+    size_t alignPage(size_t len)
+    {
+        const size_t page = sysconf(_SC_PAGESIZE);
+        return (len + page - 1) / page * page;
+    }
+
+    Ring::Ring() : fd(-1), ptr(nullptr), length(0), owner(false)
+    {
+    }
+
+    Ring::~Ring()
+    {
+        close();
+    }
+
+    bool Ring::create(const std::string & shmName, size_t slots, size_t frameSize)
+    {
+        close();
+
+        if(slots < 2)
+            slots = 2;
+
+        const size_t headerSize = alignPage(sizeof(RingHeader));
+        const size_t slotSize = alignPage(frameDataOffset + frameSize);
+
+        // recreate: readers with old mapping will see the replaced segment
+        shm_unlink(shmName.c_str());
+        fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+
+        if(0 > fd)
+        {
+            ERROR("shm_open failed, name: " << shmName << ", error: " << strerror(errno));
+            return false;
+        }
+
+        length = headerSize + slots * slotSize;
+
+        if(0 > ftruncate(fd, length))
+        {
+            ERROR("ftruncate failed, name: " << shmName << ", error: " << strerror(errno));
+            close();
+            shm_unlink(shmName.c_str());
+            return false;
+        }
+
+        void* res = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if(res == MAP_FAILED)
+        {
+            ERROR("mmap failed, name: " << shmName << ", error: " << strerror(errno));
+            close();
+            shm_unlink(shmName.c_str());
+            return false;
+        }
+
+        ptr = static_cast<uint8_t*>(res);
+        name = shmName;
+        owner = true;
+
+        auto ring = new (ptr) RingHeader();
+        ring->headerSize = headerSize;
+        ring->slotSize = slotSize;
+        ring->slots = slots;
+        ring->producer = getpid();
+        ring->sequence = 0;
+        ring->futex = 0;
+
+        for(size_t index = 0; index < slots; ++index)
+            new (ptr + headerSize + index * slotSize) FrameHeader();
+
+        // readers check magic last
+        ring->version = ringVersion;
+        std::atomic_thread_fence(std::memory_order_release);
+        ring->magic = ringMagic;
+
+        return true;
+    }
+
+    bool Ring::open(const std::string & shmName)
+    {
+        close();
+
+        fd = shm_open(shmName.c_str(), O_RDONLY, 0);
+
+        if(0 > fd)
+            return false;
+
+        struct stat st;
+
+        if(0 > fstat(fd, & st) || st.st_size < static_cast<off_t>(sizeof(RingHeader)))
+        {
+            close();
+            return false;
+        }
+
+        length = st.st_size;
+        void* res = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+
+        if(res == MAP_FAILED)
+        {
+            ERROR("mmap failed, name: " << shmName << ", error: " << strerror(errno));
+            close();
+            return false;
+        }
+
+        ptr = static_cast<uint8_t*>(res);
+        name = shmName;
+        owner = false;
+
+        auto ring = header();
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if(ring->magic != ringMagic || ring->version != ringVersion || ring->slots == 0 ||
+            ring->slotSize <= frameDataOffset || length < ring->headerSize + static_cast<size_t>(ring->slots) * ring->slotSize)
+        {
+            ERROR("unknown ring format, name: " << shmName);
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void Ring::close(void)
+    {
+        if(ptr)
+        {
+            munmap(ptr, length);
+            ptr = nullptr;
+        }
+
+        if(0 <= fd)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+
+        if(owner)
+        {
+            shm_unlink(name.c_str());
+            owner = false;
+        }
+
+        length = 0;
+    }
+
+    bool Ring::isReplaced(void) const
+    {
+        int fd2 = shm_open(name.c_str(), O_RDONLY, 0);
+
+        if(0 > fd2)
+            return true;
+
+        struct stat st1, st2;
+        bool res = 0 > fstat(fd, & st1) || 0 > fstat(fd2, & st2) || st1.st_ino != st2.st_ino;
+
+        ::close(fd2);
+        return res;
+    }
+
+    RingHeader* Ring::header(void) const
+    {
+        return reinterpret_cast<RingHeader*>(ptr);
+    }
+
+    FrameHeader* Ring::frame(uint64_t seq) const
+    {
+        auto ring = header();
+        return reinterpret_cast<FrameHeader*>(ptr + ring->headerSize + ((seq - 1) % ring->slots) * ring->slotSize);
+    }
+
+    uint8_t* Ring::frameData(uint64_t seq) const
+    {
+        return reinterpret_cast<uint8_t*>(frame(seq)) + frameDataOffset;
+    }
+
+    size_t Ring::frameSize(void) const
+    {
+        return header()->slotSize - frameDataOffset;
+    }
+
+    uint64_t Ring::sequence(void) const
+    {
+        return header()->sequence.load(std::memory_order_acquire);
+    }
+
+    bool Ring::waitFrame(uint64_t seen, int ms) const
+    {
+        auto ring = header();
+        uint32_t val = ring->futex.load(std::memory_order_acquire);
+
+        if(seen < sequence())
+            return true;
+
+        struct timespec ts;
+        ts.tv_sec = ms / 1000;
+        ts.tv_nsec = (ms % 1000) * 1000000;
+
+        syscall(SYS_futex, & ring->futex, FUTEX_WAIT, val, & ts, nullptr, 0);
+
+        return seen < sequence();
+    }
+
+    uint8_t* Ring::writeBegin(const FrameHeader & info)
+    {
+        auto seq = sequence() + 1;
+        auto fh = frame(seq);
+
+        fh->sequence.store(2 * seq - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        fh->width = info.width;
+        fh->height = info.height;
+        fh->pitch = info.pitch;
+        fh->bitsPerPixel = info.bitsPerPixel;
+        fh->rmask = info.rmask;
+        fh->gmask = info.gmask;
+        fh->bmask = info.bmask;
+        fh->amask = info.amask;
+
+        return frameData(seq);
+    }
+
+    void Ring::writeCommit(void)
+    {
+        auto ring = header();
+        auto seq = sequence() + 1;
+        auto fh = frame(seq);
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, & ts);
+        fh->timestamp = ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+
+        fh->sequence.store(2 * seq, std::memory_order_release);
+        ring->sequence.store(seq, std::memory_order_release);
+        ring->futex.fetch_add(1, std::memory_order_release);
+
+        syscall(SYS_futex, & ring->futex, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+}
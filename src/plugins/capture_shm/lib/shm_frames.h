@@ -0,0 +1,143 @@
+/***************************************************************************
+ *   Copyright (C) 2022 by MultiCapture team <public.irkutsk@gmail.com>    *
+ *                                                                         *
+ *   Part of the MultiCapture engine:                                      *
+ *   https://github.com/AndreyBarmaley/multi-capture                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef _SHM_FRAMES_
+#define _SHM_FRAMES_
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+/*
+    POSIX shared memory frames ring, version 1
+
+    layout:
+        RingHeader                      offset 0
+        slot[index], index < slots      offset headerSize + index * slotSize
+            FrameHeader                 slot offset
+            pixels                      slot offset + frameDataOffset, FrameHeader::pitch * FrameHeader::height bytes
+
+    writer, frame N (N = 1, 2, ...):
+        slot = (N - 1) % slots
+        FrameHeader::sequence = 2 * N - 1       (odd: slot writing)
+        fill FrameHeader fields and pixels
+        FrameHeader::sequence = 2 * N           (release)
+        RingHeader::sequence = N                (release)
+        RingHeader::futex += 1, FUTEX_WAKE all
+
+    reader, without locks:
+        N = RingHeader::sequence                (acquire, 0: no frames)
+        check FrameHeader::sequence == 2 * N, copy pixels, check FrameHeader::sequence again:
+        changed value means the slot was overwritten, skip the frame
+
+    waiting: FUTEX_WAIT (shared, not private) on RingHeader::futex with the last seen value
+    pixel format: bitsPerPixel and rgba masks, as SDL_CreateRGBSurfaceFrom, native byte order
+*/
+
+namespace ShmFrames
+{
+    const uint32_t ringMagic = 0x5253434D; // 'MCSR'
+    const uint32_t ringVersion = 1;
+    const uint32_t frameDataOffset = 64;
+
+    struct RingHeader
+    {
+        uint32_t        magic;
+        uint32_t        version;
+        uint32_t        headerSize;             /// offset of first slot
+        uint32_t        slotSize;               /// bytes per slot, frame header included
+        uint32_t        slots;
+        uint32_t        producer;               /// producer pid
+        std::atomic<uint64_t> sequence;         /// last complete frame, 0: none
+        std::atomic<uint32_t> futex;            /// changed on every frame
+    };
+
+    struct FrameHeader
+    {
+        std::atomic<uint64_t> sequence;         /// 2N-1: writing, 2N: frame N complete
+        uint64_t        timestamp;              /// CLOCK_REALTIME, microseconds
+        uint32_t        width;
+        uint32_t        height;
+        uint32_t        pitch;
+        uint32_t        bitsPerPixel;
+        uint32_t        rmask;
+        uint32_t        gmask;
+        uint32_t        bmask;
+        uint32_t        amask;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomic required");
+    static_assert(sizeof(FrameHeader) <= frameDataOffset, "frame header size");
+
+    class Ring
+    {
+        std::string     name;
+        int             fd;
+        uint8_t*        ptr;
+        size_t          length;
+        bool            owner;
+
+    public:
+        Ring();
+        ~Ring();
+
+        bool            create(const std::string &, size_t slots, size_t frameSize);
+        bool            open(const std::string &);
+        void            close(void);
+
+        bool            isOpen(void) const { return ptr != nullptr; }
+        bool            isReplaced(void) const;
+
+        RingHeader*     header(void) const;
+        FrameHeader*    frame(uint64_t seq) const;
+        uint8_t*        frameData(uint64_t seq) const;
+        size_t          frameSize(void) const;
+
+        uint64_t        sequence(void) const;
+        bool            waitFrame(uint64_t seen, int ms) const;
+
+        uint8_t*        writeBegin(const FrameHeader &);
+        void            writeCommit(void);
+
+        /// call func(const FrameHeader &, const uint8_t* pixels) for frame seq, false if overwritten or broken
+        template<typename Func>
+        bool readFrame(uint64_t seq, Func func) const
+        {
+            auto fh = frame(seq);
+
+            if(fh->sequence.load(std::memory_order_acquire) != 2 * seq)
+                return false;
+
+            // torn values are possible here, validate bounds before use
+            if(frameSize() < static_cast<size_t>(fh->pitch) * fh->height ||
+                fh->pitch < static_cast<size_t>(fh->width) * ((fh->bitsPerPixel + 7) >> 3))
+                return false;
+
+            func(*fh, frameData(seq));
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return fh->sequence.load(std::memory_order_relaxed) == 2 * seq;
+        }
+    };
+}
+
+#endif
@@ -63,10 +63,8 @@ struct capture_vnc_t : RFB::ClientConnector
         password.clear();
     }
 
-    void serverFBUpdateEvent(void) override
+    bool frameBufferReady(void) override
     {
-        RFB::ClientConnector::serverFBUpdateEvent();
-
         if(frames.size() < 3)
         {
             Surface frame;
@@ -74,7 +72,10 @@ struct capture_vnc_t : RFB::ClientConnector
             frames.push_back(frame);
 
             DisplayScene::pushEvent(nullptr, ActionFrameComplete, this);
+            return true;
         }
+
+        return false;
     }
 
     bool init(void)
@@ -26,6 +26,10 @@
 #include <fstream>
 #include <algorithm>
 
+#ifdef WITH_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
 #include "../../settings.h"
 #include "capture_vnc_connector.h"
 
@@ -33,11 +37,79 @@ using namespace std::chrono_literals;
 
 namespace RFB
 {
+#ifdef WITH_TURBOJPEG
+    /// turbojpeg pixel format for direct decoding into frame buffer, or -1
+    int turboJpegFormat(const PixelFormat & pf)
+    {
+        if(pf.bitsPerPixel != 32 || pf.redMax != 255 || pf.greenMax != 255 || pf.blueMax != 255)
+            return -1;
+
+        // byte position of components in memory
+#if (__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__)
+        auto rpos = pf.redShift >> 3;
+        auto gpos = pf.greenShift >> 3;
+        auto bpos = pf.blueShift >> 3;
+#else
+        auto rpos = 3 - (pf.redShift >> 3);
+        auto gpos = 3 - (pf.greenShift >> 3);
+        auto bpos = 3 - (pf.blueShift >> 3);
+#endif
+
+        if(rpos == 0 && gpos == 1 && bpos == 2)
+            return TJPF_RGBX;
+
+        if(rpos == 2 && gpos == 1 && bpos == 0)
+            return TJPF_BGRX;
+
+        if(rpos == 1 && gpos == 2 && bpos == 3)
+            return TJPF_XRGB;
+
+        if(rpos == 3 && gpos == 2 && bpos == 1)
+            return TJPF_XBGR;
+
+        return -1;
+    }
+#endif
+
     /* Connector */
     ClientConnector::ClientConnector(const SWE::JsonObject & jo)
-        : streamIn(nullptr), streamOut(nullptr), debug(0), loopMessage(true), config(& jo)
+        : streamIn(nullptr), streamOut(nullptr), debug(0), loopMessage(true), config(& jo), fbSyncIndex(0), decodingThreads(1),
+            updateRequested(false), continuousUpdates(true), continuousEnabled(false), fbChanged(false), updateInterval(0),
+            jpegQuality(-1), jpegDecoder(nullptr)
     {
         debug = config->getInteger("debug", 0);
+        decodingThreads = config->getInteger("threads", 2);
+
+        if(decodingThreads < 1)
+            decodingThreads = 1;
+        else if(std::thread::hardware_concurrency() < decodingThreads)
+        {
+            decodingThreads = std::thread::hardware_concurrency();
+            ERROR("decoding threads incorrect, fixed to hardware concurrency: " << decodingThreads);
+        }
+
+        // frames limit, 0: unlimited
+        int fps = config->getInteger("fps", 25);
+        if(0 < fps)
+            updateInterval = std::chrono::microseconds(1000000 / fps);
+
+        continuousUpdates = config->getBoolean("continuous", true);
+
+#ifdef WITH_TURBOJPEG
+        // tight jpeg quality level 0-9, -1: disabled
+        jpegQuality = std::min(config->getInteger("jpeg:quality", 6), 9);
+
+        if(0 <= jpegQuality)
+        {
+            jpegDecoder = tjInitDecompress();
+
+            if(! jpegDecoder)
+            {
+                ERROR("turbojpeg init failed, jpeg disabled");
+                jpegQuality = -1;
+            }
+        }
+#endif
 
         // file debug
         auto netDebug = config->getString("network:debug");
@@ -45,11 +117,23 @@ namespace RFB
         if(netDebug.size())
             socket.reset(new Network::TCPClientDebug(netDebug));
         else
+        {
             socket.reset(new Network::TCPClient());
+            // buffered input, the debug stream dumps every read and stays unbuffered
+            socket->setRecvBuffer(64 * 1024);
+        }
 
         streamIn = streamOut = socket.get();
     }
 
+    ClientConnector::~ClientConnector()
+    {
+#ifdef WITH_TURBOJPEG
+        if(jpegDecoder)
+            tjDestroy(jpegDecoder);
+#endif
+    }
+
     void ClientConnector::sendFlush(void)
     {
         if(loopMessage)
@@ -80,7 +164,7 @@ namespace RFB
 
     bool ClientConnector::communication(const std::string & host, int port, const std::string & password)
     {
-        if(! static_cast<Network::TCPClient*>(socket.get())->connect(host, port))
+        if(! socket->connect(host, port))
         {
             ERROR("connect failed: " << host << ":" << port);
             return false;
@@ -241,6 +325,13 @@ namespace RFB
 
         fbPtr.reset(new FrameBuffer(Region(0, 0, fbWidth, fbHeight), clientFormat));
 
+        for(auto & sync : fbSync)
+        {
+            sync.surface.reset();
+            sync.dirty.clear();
+            sync.full = true;
+        }
+
         // recv name desktop
         auto nameLen = recvIntBE32();
         auto nameDesktop = recvString(nameLen);
@@ -253,10 +344,18 @@ namespace RFB
 
     void ClientConnector::messages(void)
     {
-        std::initializer_list<int> encodings = { ENCODING_LAST_RECT,
-                                        ENCODING_ZRLE, ENCODING_TRLE, ENCODING_HEXTILE,
+        std::vector<int> encodings = { ENCODING_LAST_RECT, ENCODING_COPYRECT,
+                                        ENCODING_TIGHT, ENCODING_ZRLE, ENCODING_TRLE, ENCODING_HEXTILE,
                                         ENCODING_ZLIB, ENCODING_CORRE, ENCODING_RRE, ENCODING_RAW };
 
+        // tight jpeg allowed by quality level
+        if(0 <= jpegQuality)
+            encodings.push_back(ENCODING_QUALITY0 + jpegQuality);
+
+        // server confirm with EndOfContinuousUpdates
+        if(continuousUpdates)
+            encodings.push_back(ENCODING_CONTINUOUS_UPDATES);
+
         clientSetEncodings(encodings);
         clientPixelFormat();
         // request full update
@@ -265,19 +364,28 @@ namespace RFB
         if(this->debug)
             DEBUG("RFB 1.7.5" << ", wait remote messages...");
 
-        auto cur = std::chrono::steady_clock::now();
+        updateNext = frameNext = std::chrono::steady_clock::now();
 
         while(this->loopMessage)
         {
             auto now = std::chrono::steady_clock::now();
 
-            if(std::chrono::milliseconds(300) <= now - cur)
+            if(fbChanged && frameNext <= now)
             {
-                // request incr update
-                clientFrameBufferUpdateReq(true);
-                cur = now;
+                if(frameBufferReady())
+                {
+                    fbChanged = false;
+                    frameNext = now + updateInterval;
+                }
+                else
+                {
+                    // frames queue full, retry later
+                    frameNext = now + std::max<std::chrono::microseconds>(updateInterval, 10ms);
+                }
             }
 
+            clientUpdateRequestNext();
+
             if(this->hasInput())
             {
                 int msgType = this->recvInt8();
@@ -288,6 +396,7 @@ namespace RFB
                     case SERVER_SET_COLOURMAP:      this->serverSetColorMapEvent(); break;
                     case SERVER_BELL:               this->serverBellEvent(); break;
                     case SERVER_CUT_TEXT:           this->serverCutTextEvent(); break;
+                    case SERVER_END_CONTINUOUS_UPDATES: this->serverEndContinuousUpdatesEvent(); break;
 
                     default:
                     {
@@ -298,11 +407,44 @@ namespace RFB
             }
             else
             {
-                std::this_thread::sleep_for(5ms);
+                // wait server data, next frame or next update request time
+                auto wait = std::chrono::steady_clock::time_point::max();
+
+                if(fbChanged)
+                    wait = frameNext;
+
+                if(! continuousEnabled && ! updateRequested)
+                    wait = std::min(wait, updateNext);
+
+                auto timeout = 100ms;
+                now = std::chrono::steady_clock::now();
+
+                if(wait != std::chrono::steady_clock::time_point::max())
+                    timeout = std::min(timeout, std::chrono::duration_cast<std::chrono::milliseconds>(wait - now) + 1ms);
+
+                if(0ms < timeout)
+                    socket->waitInput(timeout.count());
             }
         }
     }
 
+    bool ClientConnector::clientUpdateRequestNext(void)
+    {
+        if(continuousEnabled || updateRequested)
+            return false;
+
+        auto now = std::chrono::steady_clock::now();
+
+        if(now < updateNext)
+            return false;
+
+        // keep one request in flight
+        clientFrameBufferUpdateReq(true);
+        updateNext = now + updateInterval;
+
+        return true;
+    }
+
     void ClientConnector::clientPixelFormat(void)
     {
         auto & clientFormat = fbPtr->pixelFormat();
@@ -336,7 +478,7 @@ namespace RFB
         sendFlush();
     }
 
-    void ClientConnector::clientSetEncodings(std::initializer_list<int> encodings)
+    void ClientConnector::clientSetEncodings(const std::vector<int> & encodings)
     {
         if(debug)
             DEBUG("RFB 1.7.4.2" << ", count: " << encodings.size());
@@ -367,6 +509,26 @@ namespace RFB
         sendIntBE16(reg.w);
         sendIntBE16(reg.h);
         sendFlush();
+
+        updateRequested = true;
+    }
+
+    void ClientConnector::clientEnableContinuousUpdates(bool enable)
+    {
+        auto & reg = fbPtr->region();
+
+        if(debug)
+            DEBUG("RFB 1.7.4.7" << ", enable: " << SWE::String::Bool(enable) << ", region [" << reg.x << "," << reg.y << "," << reg.w << "," << reg.h << "]");
+
+        sendInt8(CLIENT_ENABLE_CONTINUOUS_UPDATES);
+        sendInt8(enable ? 1 : 0);
+        sendIntBE16(reg.x);
+        sendIntBE16(reg.y);
+        sendIntBE16(reg.w);
+        sendIntBE16(reg.h);
+        sendFlush();
+
+        continuousEnabled = enable;
     }
 
     void ClientConnector::serverFBUpdateEvent(void)
@@ -381,6 +543,10 @@ namespace RFB
         if(debug)
             DEBUG("RFB 1.7.5.1" << ", num rects: " << numRects);
 
+        // pipelining: the server prepares the next update while this one is decoded
+        updateRequested = false;
+        clientUpdateRequestNext();
+
         const std::lock_guard<std::mutex> lock(fbChange);
 
         while(0 < numRects--)
@@ -400,6 +566,8 @@ namespace RFB
             switch(encodingType)
             {
                 case ENCODING_RAW:      recvDecodingRaw(reg); break;
+                case ENCODING_COPYRECT: recvDecodingCopyRect(reg); break;
+                case ENCODING_TIGHT:    recvDecodingTight(reg); break;
                 case ENCODING_RRE:      recvDecodingRRE(reg, false); break;
                 case ENCODING_CORRE:    recvDecodingRRE(reg, true); break;
                 case ENCODING_HEXTILE:  recvDecodingHexTile(reg); break;
@@ -415,8 +583,13 @@ namespace RFB
                 default:
                     throw std::runtime_error(SWE::StringFormat("%1: unknown encoding: %2").arg(__FUNCTION__).arg(SWE::String::hex(encodingType, 8)));
             }
+
+            if(encodingType != ENCODING_LAST_RECT)
+                fbDirtyRegion(reg);
         }
 
+        fbChanged = true;
+
         if(debug)
             DEBUG("fb update: " << SWE::Tools::ticks() - tick << "ms");
     }
@@ -462,6 +635,40 @@ namespace RFB
             recvSkip(length);
     }
 
+    void ClientConnector::fbDirtyRegion(const Region & reg)
+    {
+        for(auto & sync : fbSync)
+        {
+            if(sync.full)
+                continue;
+
+            // many small rects, a single full copy is cheaper
+            if(256 < sync.dirty.size())
+            {
+                sync.dirty.clear();
+                sync.full = true;
+            }
+            else
+                sync.dirty.push_back(reg);
+        }
+    }
+
+    void ClientConnector::serverEndContinuousUpdatesEvent(void)
+    {
+        if(debug)
+            DEBUG("RFB 1.7.5.5" << ", continuous updates: " << SWE::String::Bool(continuousEnabled));
+
+        // first time: server supported, enable; next times: server stopped it, back to requests
+        if(continuousEnabled)
+        {
+            continuousEnabled = false;
+            continuousUpdates = false;
+        }
+        else
+        if(continuousUpdates)
+            clientEnableContinuousUpdates(true);
+    }
+
     void ClientConnector::syncFrameBuffer(Surface & sf)
     {
         const std::lock_guard<std::mutex> lock(fbChange);
@@ -470,7 +677,109 @@ namespace RFB
         SDL_Surface* ptr = SDL_CreateRGBSurfaceFrom(fbPtr->pitchData(0), fbPtr->width(), fbPtr->height(),
                             fbPtr->bitsPerPixel(), fbPtr->pitchSize(), pixelFormat.rmask(), pixelFormat.gmask(), pixelFormat.bmask(), 0);
 
-        sf = Surface::copy(ptr);
+        // alternate buffers, the other one may still be displayed
+        fbSyncIndex = (fbSyncIndex + 1) % fbSync.size();
+        auto & sync = fbSync[fbSyncIndex];
+
+        // surface shares SDL_Surface by refcount: still held by consumer, make new
+        if(! sync.full && (! sync.surface.isValid() || 1 < sync.surface.toSDLSurface()->refcount))
+            sync.full = true;
+
+        if(sync.full)
+        {
+            sync.surface = Surface::copy(ptr);
+
+            if(2 < debug)
+                DEBUG("sync frame buffer: " << "full");
+        }
+        else
+        {
+            for(auto & reg : sync.dirty)
+            {
+                SDL_Rect rt{ reg.x, reg.y, reg.w, reg.h };
+
+                if(0 != SDL_BlitSurface(ptr, & rt, sync.surface.toSDLSurface(), & rt))
+                    ERROR(SDL_GetError());
+            }
+
+            if(2 < debug)
+                DEBUG("sync frame buffer: " << "regions: " << sync.dirty.size());
+
+            SDL_FreeSurface(ptr);
+        }
+
+        sync.dirty.clear();
+        sync.full = false;
+
+        sf = sync.surface;
+    }
+
+    void ClientConnector::runDecodingJobs(std::list< std::function<void(void)> > & jobs)
+    {
+        if(decodingThreads < 2 || jobs.size() < 2)
+        {
+            for(auto & job : jobs)
+                job();
+
+            return;
+        }
+
+        // make pool jobs
+        while(static_cast<int>(jobsDecodings.size()) < decodingThreads && ! jobs.empty())
+        {
+            jobsDecodings.push_back(std::async(std::launch::async, jobs.front()));
+            jobs.pop_front();
+        }
+
+        std::exception_ptr error;
+
+        // renew completed job, stop scheduling on decoding error
+        while(! jobs.empty() && ! error)
+        {
+            for(auto & job : jobsDecodings)
+            {
+                if(jobs.empty())
+                    break;
+
+                if(job.wait_for(std::chrono::microseconds(100)) == std::future_status::ready)
+                {
+                    try
+                    {
+                        job.get();
+                    }
+                    catch(...)
+                    {
+                        error = std::current_exception();
+                        break;
+                    }
+
+                    job = std::async(std::launch::async, jobs.front());
+                    jobs.pop_front();
+                }
+            }
+        }
+
+        // wait jobs, rethrow decoding errors
+        for(auto & job : jobsDecodings)
+        {
+            if(! job.valid())
+                continue;
+
+            try
+            {
+                job.get();
+            }
+            catch(...)
+            {
+                if(! error)
+                    error = std::current_exception();
+            }
+        }
+
+        jobsDecodings.clear();
+
+        if(error)
+            std::rethrow_exception(error);
     }
 
     void ClientConnector::recvDecodingRaw(const Region & reg)
@@ -492,15 +801,265 @@ namespace RFB
         }
     }
 
+    void ClientConnector::recvDecodingCopyRect(const Region & reg)
+    {
+        int srcx = recvIntBE16();
+        int srcy = recvIntBE16();
+
+        if(2 < debug)
+        {
+            DEBUG("decoding region: [" << reg.x << "," << reg.y << "," << reg.w << "," << reg.h << "]" << ", src: [" << srcx << "," << srcy << "]");
+        }
+
+        auto & fbreg = fbPtr->region();
+
+        if(srcx + reg.w > fbreg.w || srcy + reg.h > fbreg.h || reg.x + reg.w > fbreg.w || reg.y + reg.h > fbreg.h)
+            throw std::runtime_error(SWE::StringFormat("%1: out of range, src: [%2,%3]").arg(__FUNCTION__).arg(srcx).arg(srcy));
+
+        const size_t bpp = fbPtr->bytePerPixel();
+        const size_t rowsz = bpp * reg.w;
+
+        // overlapped regions: move rows away from the source
+        if(srcy < reg.y)
+        {
+            for(int yy = reg.h - 1; 0 <= yy; --yy)
+                std::memmove(fbPtr->pitchData(reg.y + yy) + reg.x * bpp, fbPtr->pitchData(srcy + yy) + srcx * bpp, rowsz);
+        }
+        else
+        {
+            for(int yy = 0; yy < reg.h; ++yy)
+                std::memmove(fbPtr->pitchData(reg.y + yy) + reg.x * bpp, fbPtr->pitchData(srcy + yy) + srcx * bpp, rowsz);
+        }
+    }
+
+    void ClientConnector::recvDecodingTight(const Region & reg)
+    {
+        int control = recvInt8();
+
+        if(2 < debug)
+        {
+            DEBUG("decoding region: [" << reg.x << "," << reg.y << "," << reg.w << "," << reg.h << "]" << ", control: " << SWE::String::hex(control, 2));
+        }
+
+        // reset zlib streams
+        for(size_t id = 0; id < tightZlib.size(); ++id)
+            if(control & (1 << id)) tightZlib[id].reset();
+
+        control >>= 4;
+
+        if(TIGHT_FILL == control)
+        {
+            fbPtr->fillPixel(reg, recvTPixel(*this));
+            return;
+        }
+
+        if(TIGHT_JPEG == control)
+        {
+            recvDecodingTightJpeg(reg);
+            return;
+        }
+
+        if(TIGHT_JPEG < control)
+            throw std::runtime_error(SWE::StringFormat("%1: unsupported compression: %2").arg(__FUNCTION__).arg(control));
+
+        // basic compression
+        const int zlibId = control & 0x03;
+        const int filter = (control & TIGHT_EXPLICIT_FILTER) ? recvInt8() : TIGHT_FILTER_COPY;
+        const size_t pixels = reg.w * reg.h;
+        std::vector<uint8_t> raw;
+
+        if(3 < debug)
+        {
+            DEBUG("type: " << "basic" << ", zlib: " << zlibId << ", filter: " << filter);
+        }
+
+        if(TIGHT_FILTER_COPY == filter)
+        {
+            const size_t len = pixels * cpixelSize();
+            Network::MemoryStream data(recvTightData(len, zlibId, raw), len);
+
+            for(auto coord = PointIterator(0, 0, reg.toSize()); coord.isValid(); ++coord)
+                fbPtr->setPixel(reg.topLeft() + coord, recvTPixel(data));
+        }
+        else
+        if(TIGHT_FILTER_PALETTE == filter)
+        {
+            std::vector<int> palette(recvInt8() + 1);
+            for(auto & val : palette) val = recvTPixel(*this);
+
+            if(2 == palette.size())
+            {
+                // one bit per pixel, rows padded to byte
+                const size_t rowsz = (reg.w + 7) >> 3;
+                auto data = recvTightData(rowsz * reg.h, zlibId, raw);
+
+                for(int oy = 0; oy < reg.h; ++oy)
+                {
+                    for(int ox = 0; ox < reg.w; ++ox)
+                    {
+                        auto index = (data[oy * rowsz + (ox >> 3)] >> (7 - (ox & 7))) & 0x01;
+                        fbPtr->setPixel(reg.topLeft() + Point(ox, oy), palette[index]);
+                    }
+                }
+            }
+            else
+            {
+                auto data = recvTightData(pixels, zlibId, raw);
+
+                for(auto coord = PointIterator(0, 0, reg.toSize()); coord.isValid(); ++coord)
+                {
+                    size_t index = *data++;
+
+                    if(index >= palette.size())
+                        throw std::runtime_error(SWE::StringFormat("%1: out of range, index: %2, palette size: %3").arg(__FUNCTION__).arg(index).arg(palette.size()));
+
+                    fbPtr->setPixel(reg.topLeft() + coord, palette[index]);
+                }
+            }
+        }
+        else
+        if(TIGHT_FILTER_GRADIENT == filter)
+        {
+            if(3 != cpixelSize())
+                throw std::runtime_error(SWE::StringFormat("%1: gradient filter, unsupported pixel format").arg(__FUNCTION__));
+
+            auto & pf = fbPtr->pixelFormat();
+            auto data = recvTightData(pixels * 3, zlibId, raw);
+            std::vector<int> prev(reg.w * 3, 0);
+            std::vector<int> cur(reg.w * 3, 0);
+
+            for(int oy = 0; oy < reg.h; ++oy)
+            {
+                for(int ox = 0; ox < reg.w; ++ox)
+                {
+                    for(int cc = 0; cc < 3; ++cc)
+                    {
+                        int left = ox ? cur[(ox - 1) * 3 + cc] : 0;
+                        int upleft = ox ? prev[(ox - 1) * 3 + cc] : 0;
+                        int predict = std::clamp(left + prev[ox * 3 + cc] - upleft, 0, 255);
+
+                        cur[ox * 3 + cc] = (predict + *data++) & 0xFF;
+                    }
+
+                    fbPtr->setPixel(reg.topLeft() + Point(ox, oy), pf.pixel(Color(cur[ox * 3], cur[ox * 3 + 1], cur[ox * 3 + 2])));
+                }
+
+                prev.swap(cur);
+            }
+        }
+        else
+        {
+            throw std::runtime_error(SWE::StringFormat("%1: unknown filter: %2").arg(__FUNCTION__).arg(filter));
+        }
+    }
+
+    void ClientConnector::recvDecodingTightJpeg(const Region & reg)
+    {
+        auto jpeg = recvData(recvCompactLength());
+
+        if(3 < debug)
+        {
+            DEBUG("type: " << "jpeg" << ", length: " << jpeg.size());
+        }
+
+#ifdef WITH_TURBOJPEG
+        if(! jpegDecoder)
+            throw std::runtime_error(SWE::StringFormat("%1: jpeg disabled").arg(__FUNCTION__));
+
+        int width = 0;
+        int height = 0;
+        int subsamp = 0;
+        int colorspace = 0;
+
+        if(0 != tjDecompressHeader3(jpegDecoder, jpeg.data(), jpeg.size(), & width, & height, & subsamp, & colorspace))
+            throw std::runtime_error(SWE::StringFormat("%1: %2").arg(__FUNCTION__).arg(tjGetErrorStr2(jpegDecoder)));
+
+        if(width != reg.w || height != reg.h)
+            throw std::runtime_error(SWE::StringFormat("%1: jpeg size mismatch: [%2,%3]").arg(__FUNCTION__).arg(width).arg(height));
+
+        auto & pf = fbPtr->pixelFormat();
+        int format = turboJpegFormat(pf);
+
+        if(0 <= format)
+        {
+            // straight into frame buffer
+            if(0 != tjDecompress2(jpegDecoder, jpeg.data(), jpeg.size(), fbPtr->pitchData(reg.y) + reg.x * fbPtr->bytePerPixel(),
+                                        reg.w, fbPtr->pitchSize(), reg.h, format, TJFLAG_FASTDCT))
+                throw std::runtime_error(SWE::StringFormat("%1: %2").arg(__FUNCTION__).arg(tjGetErrorStr2(jpegDecoder)));
+        }
+        else
+        {
+            std::vector<uint8_t> rgb(reg.w * reg.h * 3);
+
+            if(0 != tjDecompress2(jpegDecoder, jpeg.data(), jpeg.size(), rgb.data(), reg.w, reg.w * 3, reg.h, TJPF_RGB, TJFLAG_FASTDCT))
+                throw std::runtime_error(SWE::StringFormat("%1: %2").arg(__FUNCTION__).arg(tjGetErrorStr2(jpegDecoder)));
+
+            auto data = rgb.data();
+
+            for(auto coord = PointIterator(0, 0, reg.toSize()); coord.isValid(); ++coord)
+            {
+                fbPtr->setPixel(reg.topLeft() + coord, pf.pixel(Color(data[0], data[1], data[2])));
+                data += 3;
+            }
+        }
+#else
+        throw std::runtime_error(SWE::StringFormat("%1: jpeg unsupported, build without turbojpeg").arg(__FUNCTION__));
+#endif
+    }
+
+    const uint8_t* ClientConnector::recvTightData(size_t len, int zlibId, std::vector<uint8_t> & raw)
+    {
+        // RFB tight: less than 12 bytes sent uncompressed
+        if(len < 12)
+        {
+            raw.resize(len);
+            recvRaw(raw.data(), len);
+            return raw.data();
+        }
+
+        auto zipsz = recvCompactLength();
+        auto & stream = tightZlib[zlibId];
+
+        if(! stream)
+            stream.reset(new Network::InflateStream());
+
+        if(3 < debug)
+            DEBUG("compress data length: " << zipsz << ", zlib: " << zlibId);
+
+        stream->appendData(recvData(zipsz));
+        return stream->recvPtr(len);
+    }
+
+    size_t ClientConnector::recvCompactLength(void)
+    {
+        // 7 bits in the first two bytes, 8 bits in the third
+        size_t len = recvInt8();
+
+        if(len & 0x80)
+        {
+            len &= 0x7F;
+            size_t val = recvInt8();
+            len |= (val & 0x7F) << 7;
+
+            if(val & 0x80)
+                len |= static_cast<size_t>(recvInt8()) << 14;
+        }
+
+        return len;
+    }
+
     void ClientConnector::recvDecodingRRE(const Region & reg, bool corre)
     {
+        // read the buffered input stream directly, not through the connector
+        auto & in = *streamIn;
+
         if(2 < debug)
         {
             DEBUG("decoding region: [" << reg.x << "," << reg.y << "," << reg.w << "," << reg.h << "]");
         }
 
-        auto subRects = recvIntBE32();
-        auto bgColor = recvPixel();
+        auto subRects = in.recvIntBE32();
+        auto bgColor = recvPixel(in);
 
         if(3 < debug)
         {
@@ -513,21 +1072,21 @@ namespace RFB
         while(0 < subRects--)
         {
             Region dst;
-            auto pixel = recvPixel();
+            auto pixel = recvPixel(in);
 
             if(corre)
             {
-                dst.x = recvInt8();
-                dst.y = recvInt8();
-                dst.w = recvInt8();
-                dst.h = recvInt8();
+                dst.x = in.recvInt8();
+                dst.y = in.recvInt8();
+                dst.w = in.recvInt8();
+                dst.h = in.recvInt8();
             }
             else
             {
-                dst.x = recvIntBE16();
-                dst.y = recvIntBE16();
-                dst.w = recvIntBE16();
-                dst.h = recvIntBE16();
+                dst.x = in.recvIntBE16();
+                dst.y = in.recvIntBE16();
+                dst.w = in.recvIntBE16();
+                dst.h = in.recvIntBE16();
             }
 
             if(4 < debug)
@@ -563,7 +1122,10 @@ namespace RFB
 
     void ClientConnector::recvDecodingHexTileRegion(const Region & reg, int & bgColor, int & fgColor)
     {
-        auto flag = recvInt8();
+        // read the buffered input stream directly, not through the connector
+        auto & in = *streamIn;
+
+        auto flag = in.recvInt8();
 
         if(3 < debug)
         {
@@ -580,13 +1142,13 @@ namespace RFB
             FrameBuffer fb(reg, *fbPtr);
 
             for(int yy = 0; yy < reg.h; ++yy)
-                recvRaw(fb.pitchData(yy), fb.pitchSize());
+                in.recvRaw(fb.pitchData(yy), fb.pitchSize());
         }
         else
         {
             if(flag & RFB::HEXTILE_BACKGROUND)
             {
-                bgColor = recvPixel();
+                bgColor = recvPixel(in);
 
                 if(3 < debug)
                 {
@@ -598,7 +1160,7 @@ namespace RFB
 
             if(flag & HEXTILE_FOREGROUND)
             {
-                fgColor = recvPixel();
+                fgColor = recvPixel(in);
                 flag &= ~HEXTILE_COLOURED;
 
                 if(3 < debug)
@@ -609,7 +1171,7 @@ namespace RFB
 
             if(flag & HEXTILE_SUBRECTS)
             {
-                int subRects = recvInt8();
+                int subRects = in.recvInt8();
                 Region dst;
 
                 if(3 < debug)
@@ -622,15 +1184,15 @@ namespace RFB
                     auto pixel = fgColor;
                     if(flag & HEXTILE_COLOURED)
                     {
-                        pixel = recvPixel();
+                        pixel = recvPixel(in);
                         if(3 < debug)
                         {
                             DEBUG("type: " << "colored" << ", pixel: " << SWE::String::hex(pixel));
                         }
                     }
 
-                    auto val1 = recvInt8();
-                    auto val2 = recvInt8();
+                    auto val1 = in.recvInt8();
+                    auto val2 = in.recvInt8();
 
                     dst.x = (0x0F & (val1 >> 4));
                     dst.y = (0x0F & val1);
@@ -663,8 +1225,26 @@ namespace RFB
             DEBUG("decoding region: [" << reg.x << "," << reg.y << "," << reg.w << "," << reg.h << "]");
         }
 
-        zlibInflateStart();
-        recvDecodingRaw(reg);
+        auto & zlib = zlibInflateStart(ENCODING_ZLIB);
+
+        FrameBuffer fb(reg, *fbPtr);
+        const size_t rowsz = fb.pitchSize();
+        const uint8_t* data = zlib.recvPtr(rowsz * reg.h);
+
+        // inflated already, copy rows by bands
+        std::list< std::function<void(void)> > jobs;
+        const int band = 64;
+
+        for(int oy = 0; oy < reg.h; oy += band)
+        {
+            jobs.emplace_back([&fb, data, rowsz, oy, rows = std::min(band, reg.h - oy)]
+            {
+                for(int yy = oy; yy < oy + rows; ++yy)
+                    std::memcpy(fb.pitchData(yy), data + yy * rowsz, rowsz);
+            });
+        }
+
+        runDecodingJobs(jobs);
         zlibInflateStop();
     }
 
@@ -675,21 +1255,97 @@ namespace RFB
             DEBUG("decoding region: [" << reg.x << "," << reg.y << "," << reg.w << "," << reg.h << "]");
         }
 
-        const Size bsz = Size(64, 64);
+        // rfb: trle tiles 16x16, zrle tiles 64x64
+        const Size bsz = zrle ? Size(64, 64) : Size(16, 16);
 
-        if(zrle)
-            zlibInflateStart();
+        if(! zrle)
+        {
+            for(auto & reg0: Region::divideBlocks(reg, bsz))
+                recvDecodingTRLERegion(*streamIn, reg0, zrle);
+
+            return;
+        }
+
+        auto & zlib = zlibInflateStart(ENCODING_ZRLE);
+
+        // scan tiles bounds in the inflated data, then decode in parallel
+        std::list< std::function<void(void)> > jobs;
 
         for(auto & reg0: Region::divideBlocks(reg, bsz))
-            recvDecodingTRLERegion(reg0, zrle);
+        {
+            const uint8_t* begin = zlib.recvPtr(0);
+            recvSkipTRLERegion(zlib, reg0);
+            const uint8_t* end = zlib.recvPtr(0);
+
+            jobs.emplace_back([this, reg0, begin, end]
+            {
+                Network::MemoryStream tile(begin, std::distance(begin, end));
+                recvDecodingTRLERegion(tile, reg0, true);
+            });
+        }
+
+        runDecodingJobs(jobs);
+        zlibInflateStop();
+    }
+
+    size_t ClientConnector::cpixelSize(void) const
+    {
+        auto & pf = fbPtr->pixelFormat();
+        return pf.trueColor() && pf.bitsPerPixel == 32 ? 3 : pf.bytePerPixel();
+    }
+
+    void ClientConnector::recvSkipTRLERegion(const Network::InflateStream & in, const Region & reg)
+    {
+        auto type = in.recvInt8();
+        const size_t cps = cpixelSize();
+        const size_t pixels = reg.w * reg.h;
+
+        // trle raw
+        if(0 == type)
+            in.recvPtr(pixels * cps);
+        else
+        // trle solid
+        if(1 == type)
+            in.recvPtr(cps);
+        else
+        if(2 <= type && type <= 16)
+        {
+            size_t field = 4 < type ? 4 : (2 < type ? 2 : 1);
+            size_t bits = field * reg.w;
+            size_t rowsz = bits >> 3;
+            if((rowsz << 3) < bits) rowsz++;
+
+            in.recvPtr(type * cps + rowsz * reg.h);
+        }
+        else
+        if(128 == type)
+        {
+            for(size_t count = 0; count < pixels; )
+            {
+                in.recvPtr(cps);
+                count += recvRunLength(in);
+            }
+        }
+        else
+        if(130 <= type)
+        {
+            in.recvPtr((type - 128) * cps);
 
-        if(zrle)
-            zlibInflateStop();
+            for(size_t count = 0; count < pixels; )
+            {
+                auto index = in.recvInt8();
+                count += index < 128 ? 1 : recvRunLength(in);
+            }
+        }
+        else
+        {
+            throw std::runtime_error(SWE::StringFormat("%1: out of range, type: %2, unused").arg(__FUNCTION__).arg(type));
+        }
     }
 
-    void ClientConnector::recvDecodingTRLERegion(const Region & reg, bool zrle)
+    void ClientConnector::recvDecodingTRLERegion(const Network::BaseStream & in, const Region & reg, bool zrle)
     {
-        auto type = recvInt8();
+        auto type = in.recvInt8();
 
         if(3 < debug)
         {
@@ -706,7 +1362,7 @@ namespace RFB
 
             for(auto coord = PointIterator(0, 0, reg.toSize()); coord.isValid(); ++coord)
             {
-                auto pixel = recvCPixel();
+                auto pixel = recvCPixel(in);
                 fbPtr->setPixel(reg.topLeft() + coord, pixel);
             }
 
@@ -718,7 +1374,7 @@ namespace RFB
         if(1 == type)
         {
 
-            auto solid = recvCPixel();
+            auto solid = recvCPixel(in);
 
             if(3 < debug)
             {
@@ -747,7 +1403,7 @@ namespace RFB
 
             //  recv palette
             std::vector<int> palette(type);
-            for(auto & val : palette) val = recvCPixel();
+            for(auto & val : palette) val = recvCPixel(in);
 
             if(2 < debug)
             {
@@ -763,7 +1419,7 @@ namespace RFB
             // recv packed rows
             for(int oy = 0; oy < reg.h; ++oy)
             {
-                ::Tools::StreamBitsUnpack sb(recvData(rowsz), reg.w, field);
+                ::Tools::StreamBitsUnpack sb(in.recvData(rowsz), reg.w, field);
 
                 for(int ox = reg.w - 1; 0 <= ox; --ox)
                 {
@@ -802,8 +1458,8 @@ namespace RFB
 
             while(coord.isValid())
             {
-                auto pixel = recvCPixel();
-                auto runLength = recvRunLength();
+                auto pixel = recvCPixel(in);
+                auto runLength = recvRunLength(in);
 
                 if(4 < debug)
                 {
@@ -830,7 +1486,7 @@ namespace RFB
             std::vector<int> palette(palsz);
             
             for(auto & val: palette)
-                val = recvCPixel();
+                val = recvCPixel(in);
 
             if(3 < debug)
             {
@@ -847,7 +1503,7 @@ namespace RFB
 
             while(coord.isValid())
             {
-                auto index = recvInt8();
+                auto index = in.recvInt8();
 
                 if(index < 128)
                 {
@@ -867,7 +1523,7 @@ namespace RFB
                         throw std::runtime_error(SWE::StringFormat("%1: out of range, index: %2, palette size: %3").arg(__FUNCTION__).arg(index).arg(palette.size()));
 
                     auto pixel = palette[index];
-                    auto runLength = recvRunLength();
+                    auto runLength = recvRunLength(in);
 
                     if(4 < debug)
                     {
@@ -890,15 +1546,15 @@ namespace RFB
         }
     }
 
-    int ClientConnector::recvPixel(void)
+    int ClientConnector::recvPixel(const Network::BaseStream & in)
     {
         auto & pf = fbPtr->pixelFormat();
 
         switch(pf.bytePerPixel())
         {
-            case 4: return pf.bigEndian() ? recvIntBE32() : recvIntLE32();
-            case 2: return pf.bigEndian() ? recvIntBE16() : recvIntLE16();
-            case 1: return recvInt8();
+            case 4: return pf.bigEndian() ? in.recvIntBE32() : in.recvIntLE32();
+            case 2: return pf.bigEndian() ? in.recvIntBE16() : in.recvIntLE16();
+            case 1: return in.recvInt8();
             default: break;
         }
 
@@ -906,31 +1562,46 @@ namespace RFB
         return 0;
     }
 
-    int ClientConnector::recvCPixel(void)
+    int ClientConnector::recvCPixel(const Network::BaseStream & in)
     {
         auto & pf = fbPtr->pixelFormat();
 
         if(pf.trueColor() && pf.bitsPerPixel == 32)
         {
-            auto colr = recvInt8();
-            auto colg = recvInt8();
-            auto colb = recvInt8();
+            auto colr = in.recvInt8();
+            auto colg = in.recvInt8();
+            auto colb = in.recvInt8();
 #if (__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__)
             std::swap(colr, colb);
 #endif
             return pf.pixel(Color(colr, colg, colb));
         }
 
-        return recvPixel();
+        return recvPixel(in);
+    }
+
+    int ClientConnector::recvTPixel(const Network::BaseStream & in)
+    {
+        // tight: rgb order for 24 bit depth
+        if(3 == cpixelSize())
+        {
+            auto colr = in.recvInt8();
+            auto colg = in.recvInt8();
+            auto colb = in.recvInt8();
+
+            return fbPtr->pixelFormat().pixel(Color(colr, colg, colb));
+        }
+
+        return recvPixel(in);
     }
 
-    size_t ClientConnector::recvRunLength(void)
+    size_t ClientConnector::recvRunLength(const Network::BaseStream & in)
     {
         size_t length = 0;
 
         while(true)
         {
-            auto val = recvInt8();
+            auto val = in.recvInt8();
             length += val;
 
             if(val != 255)
@@ -940,8 +1611,10 @@ namespace RFB
         return 0;
     }
 
-    void ClientConnector::zlibInflateStart(bool uint16sz)
+    Network::InflateStream & ClientConnector::zlibInflateStart(int type, bool uint16sz)
     {
+        // rfb: each zlib based encoding has own stream
+        auto & zlib = zlibStreams[type];
         if(! zlib)
             zlib.reset(new Network::InflateStream());
 
@@ -959,6 +1632,7 @@ namespace RFB
         zlib->appendData(zip);
 
         streamIn = zlib.get();
+        return *zlib;
     }
     
     void ClientConnector::zlibInflateStop(void)
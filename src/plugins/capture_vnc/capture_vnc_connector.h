@@ -23,20 +23,37 @@
 #ifndef _CAPTURE_VNC_CONNECTOR_
 #define _CAPTURE_VNC_CONNECTOR_
 
+#include <map>
+#include <list>
+#include <array>
 #include <mutex>
+#include <chrono>
 #include <memory>
 #include <atomic>
+#include <future>
+#include <functional>
 
 #include "libvnc.h"
 #include "network_stream.h"
 
 namespace RFB
 {
+    /// @brief: output surface with the regions changed since it was last synced
+    struct SyncSurface
+    {
+        Surface         surface;
+        std::vector<Region> dirty;
+        bool            full;
+
+        SyncSurface() : full(true) {}
+    };
+
     /* Connector::VNC */
     class ClientConnector : protected Network::BaseStream
     {
-        std::unique_ptr<Network::BaseStream> socket;
-        std::unique_ptr<Network::InflateStream> zlib;       /// zlib layer
+        std::unique_ptr<Network::TCPClient> socket;
+        std::map<int, std::unique_ptr<Network::InflateStream>> zlibStreams; /// zlib layer: stream per encoding
+        std::array<std::unique_ptr<Network::InflateStream>, 4> tightZlib;
 
         Network::BaseStream* streamIn;
         Network::BaseStream* streamOut;
@@ -48,6 +65,23 @@ namespace RFB
         std::unique_ptr<FrameBuffer> fbPtr;
         std::mutex      fbChange;
 
+        std::array<SyncSurface, 2> fbSync;                 /// double buffered output
+        size_t          fbSyncIndex;
+
+        int             decodingThreads;
+        std::list< std::future<void> > jobsDecodings;
+
+        bool            updateRequested;                    /// update request sent, no answer yet
+        bool            continuousUpdates;
+        bool            continuousEnabled;
+        bool            fbChanged;
+        std::chrono::microseconds updateInterval;
+        std::chrono::steady_clock::time_point updateNext;
+        std::chrono::steady_clock::time_point frameNext;
+
+        int             jpegQuality;
+        void*           jpegDecoder;
+
         // network stream interface
         void            sendFlush(void) override;
         void            sendRaw(const void* ptr, size_t len) override;
@@ -55,36 +89,54 @@ namespace RFB
         bool            hasInput(void) const override;
 
         // zlib wrapper
-        void            zlibInflateStart(bool uint16sz = false);
+        Network::InflateStream & zlibInflateStart(int type, bool uint16sz = false);
         void            zlibInflateStop(void);
 
+        void            fbDirtyRegion(const Region &);
+        void            runDecodingJobs(std::list< std::function<void(void)> > &);
+        size_t          cpixelSize(void) const;
+
     protected:
         void            clientPixelFormat(void);
-        void            clientSetEncodings(std::initializer_list<int>);
+        void            clientSetEncodings(const std::vector<int> &);
         void            clientFrameBufferUpdateReq(bool incr);
         void            clientFrameBufferUpdateReq(const Region &, bool incr);
+        void            clientEnableContinuousUpdates(bool enable);
+        bool            clientUpdateRequestNext(void);
 
         virtual void    serverFBUpdateEvent(void);
         virtual void    serverSetColorMapEvent(void);
         virtual void    serverBellEvent(void);
         virtual void    serverCutTextEvent(void);
+        virtual void    serverEndContinuousUpdatesEvent(void);
+
+        /// frame buffer changed, called from message thread not often than fps, return false for retry
+        virtual bool    frameBufferReady(void) { return true; }
 
         void            recvDecodingRaw(const Region &);
         void            recvDecodingRRE(const Region &, bool corre);
         void            recvDecodingHexTile(const Region &);
         void            recvDecodingHexTileRegion(const Region &, int & bgColor, int & fgColor);
         void            recvDecodingTRLE(const Region &, bool zrle);
-        void            recvDecodingTRLERegion(const Region &, bool zrle);
+        void            recvDecodingTRLERegion(const Network::BaseStream &, const Region &, bool zrle);
+        void            recvSkipTRLERegion(const Network::InflateStream &, const Region &);
         void            recvDecodingZlib(const Region &);
         void            recvDecodingLastRect(const Region &);
-
-        int             recvPixel(void);
-        int             recvCPixel(void);
-        size_t          recvRunLength(void);
+        void            recvDecodingCopyRect(const Region &);
+        void            recvDecodingTight(const Region &);
+        void            recvDecodingTightJpeg(const Region &);
+        const uint8_t*  recvTightData(size_t len, int zlibId, std::vector<uint8_t> &);
+        size_t          recvCompactLength(void);
+
+        int             recvPixel(void) { return recvPixel(*streamIn); }
+        int             recvPixel(const Network::BaseStream &);
+        int             recvCPixel(const Network::BaseStream &);
+        int             recvTPixel(const Network::BaseStream &);
+        size_t          recvRunLength(const Network::BaseStream &);
 
     public:
         ClientConnector(const SWE::JsonObject &);
-        virtual ~ClientConnector(){}
+        virtual ~ClientConnector();
 
         bool            communication(const std::string &, int, const std::string & pass = "");
         void            messages(void);
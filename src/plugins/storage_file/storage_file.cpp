@@ -47,6 +47,7 @@ struct storage_file_t
     size_t      sessionId;
     std::string sessionName;
     std::string format;
+    FormatTemplate formatTemplate;
     std::string filename;
     Surface	surface;
     Size        scale;
@@ -98,6 +99,8 @@ void* storage_file_init(const JsonObject & config)
 
     DEBUG("params: " << "filename = " << ptr->format);
 
+    ptr->formatTemplate = FormatTemplate(ptr->format);
+
     return ptr.release();
 }
 
@@ -144,13 +147,7 @@ int storage_file_store_action(void* ptr, const std::string & signal)
     if(true)
     {
         const std::lock_guard<std::mutex> lock(st->change);
-        st->filename = String::strftime(st->format);
-
-        if(0 < st->sessionId)
-    	    st->filename = String::replace(st->filename, "${sid}", st->sessionId);
-
-        if(! st->sessionName.empty())
-    	    st->filename = String::replace(st->filename, "${session}", st->sessionName);
+        st->filename = st->formatTemplate.render(st->sessionId, st->sessionName);
     }
 
     std::string dir = Systems::dirname(st->filename);
@@ -20,14 +20,40 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#include <list>
+#include <array>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
 #include "../../settings.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-const int storage_script_version = 20220415;
+using namespace std::chrono_literals;
+const int storage_script_version = 20220419;
+
+/* worker mode protocol:
+ * the exec command started once, stdin and stdout connected to plugin,
+ * for each store action the image filename sent as line to stdin,
+ * the worker reply one line to stdout for each filename (result or error text)
+ */
+struct script_job_t
+{
+    Surface     surface;
+    std::string filename;
+};
 
 struct storage_script_t
 {
@@ -36,11 +62,26 @@ struct storage_script_t
     std::string sessionName;
     std::string command;
     std::string format;
+    FormatTemplate formatTemplate;
     std::string filename;
     Surface	surface;
     std::mutex  change;
 
-    storage_script_t() : debug(0), sessionId(0) {}
+    bool        worker;
+    size_t      workerQueue;
+    size_t      workerSeq;
+    std::atomic<int> workerFd;
+    pid_t       workerPid;
+    std::atomic<size_t> workerInFlight;
+    std::atomic<bool> shutdown;
+    std::list<script_job_t> jobs;
+    std::mutex  jobsLock;
+    std::condition_variable jobsCond;
+    std::thread threadWriter;
+    std::thread threadReader;
+
+    storage_script_t() : debug(0), sessionId(0), worker(false), workerQueue(8),
+        workerSeq(0), workerFd(-1), workerPid(-1), workerInFlight(0), shutdown(false) {}
     ~storage_script_t()
     {
 	clear();
@@ -48,12 +89,221 @@ struct storage_script_t
     
     void clear(void)
     {
+        if(worker)
+            workerStop();
+
         debug = 0;
         sessionId = 0;
         sessionName.clear();
         command.clear();
         filename.clear();
 	surface.reset();
+        worker = false;
+    }
+
+    bool workerSpawn(void)
+    {
+        int sv[2];
+
+        if(0 > socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv))
+        {
+            ERROR("socketpair failed, error: " << strerror(errno));
+            return false;
+        }
+
+        pid_t pid = Coprocess::spawn(command, sv[1], sv[1]);
+
+        if(0 > pid)
+        {
+            ERROR("fork failed, error: " << strerror(errno));
+            close(sv[0]);
+            close(sv[1]);
+            return false;
+        }
+
+        close(sv[1]);
+
+        workerPid = pid;
+        workerFd = sv[0];
+
+        if(debug) DEBUG("worker started, pid: " << workerPid);
+        return true;
+    }
+
+    void workerKill(void)
+    {
+        if(0 <= workerFd)
+        {
+            close(workerFd);
+            workerFd = -1;
+        }
+
+        if(0 < workerPid)
+        {
+            Coprocess::terminate(workerPid);
+            workerPid = -1;
+        }
+    }
+
+    // return false if queue full
+    bool workerPush(const Surface & sf, const std::string & file)
+    {
+        const std::lock_guard<std::mutex> lock(jobsLock);
+
+        if(workerQueue <= jobs.size() + workerInFlight)
+            return false;
+
+        jobs.push_back(script_job_t{ sf, file });
+        jobsCond.notify_one();
+        return true;
+    }
+
+    void workerStart(void)
+    {
+        shutdown = false;
+
+        // save image and send filename to worker
+        threadWriter = std::thread([st = this]
+        {
+            while(! st->shutdown)
+            {
+                script_job_t job;
+
+                if(true)
+                {
+                    std::unique_lock<std::mutex> lock(st->jobsLock);
+                    st->jobsCond.wait(lock, [st]{ return st->shutdown || ! st->jobs.empty(); });
+
+                    if(st->shutdown)
+                        break;
+
+                    job = std::move(st->jobs.front());
+                    st->jobs.pop_front();
+                    st->workerInFlight++;
+                }
+
+                // exited, reap and restart outside the lock: workerPush is not blocked
+                if(0 > st->workerFd)
+                {
+                    st->workerKill();
+                    st->workerSpawn();
+                }
+
+                if(2 < st->debug)
+                    DEBUG("save: " << job.filename);
+
+                job.surface.save(job.filename);
+
+                if(! Systems::isFile(job.filename))
+                {
+                    ERROR("write image error: " << job.filename);
+                    st->workerInFlight--;
+                    continue;
+                }
+
+                std::string line = job.filename;
+                line.append("\n");
+
+                const std::lock_guard<std::mutex> lock(st->jobsLock);
+                const int fd = st->workerFd;
+                bool res = 0 <= fd;
+
+                for(size_t pos = 0; res && pos < line.size(); )
+                {
+                    ssize_t len = send(fd, line.data() + pos, line.size() - pos, MSG_NOSIGNAL);
+
+                    if(0 < len)
+                        pos += len;
+                    else
+                    if(0 > len && errno == EINTR)
+                        continue;
+                    else
+                        res = false;
+                }
+
+                if(! res)
+                {
+                    ERROR("worker write failed, command: " << st->command);
+                    st->workerInFlight--;
+                }
+            }
+        });
+
+        // worker replies
+        threadReader = std::thread([st = this]
+        {
+            std::string line;
+            std::array<char, 1024> buf;
+
+            while(! st->shutdown)
+            {
+                // closed only by this thread, the writer restarts after
+                int fd = st->workerFd;
+
+                if(0 > fd)
+                {
+                    std::this_thread::sleep_for(100ms);
+                    continue;
+                }
+
+                struct pollfd pfd = { fd, POLLIN, 0 };
+                if(0 >= poll(& pfd, 1, 100))
+                    continue;
+
+                ssize_t len = recv(fd, buf.data(), buf.size(), MSG_DONTWAIT);
+
+                if(0 > len && (errno == EINTR || errno == EAGAIN))
+                    continue;
+
+                if(0 >= len)
+                {
+                    const std::lock_guard<std::mutex> lock(st->jobsLock);
+
+                    if(fd == st->workerFd)
+                    {
+                        ERROR("worker exited, command: " << st->command << ", lost: " << st->workerInFlight);
+                        st->workerFd = -1;
+                        close(fd);
+                        st->workerInFlight = 0;
+                    }
+
+                    line.clear();
+                    continue;
+                }
+
+                line.append(buf.data(), len);
+
+                for(auto pos = line.find('\n'); pos != std::string::npos; pos = line.find('\n'))
+                {
+                    if(2 < st->debug)
+                        DEBUG("worker result: " << line.substr(0, pos));
+
+                    line.erase(0, pos + 1);
+
+                    if(0 < st->workerInFlight)
+                        st->workerInFlight--;
+                }
+            }
+        });
+    }
+
+    void workerStop(void)
+    {
+        if(true)
+        {
+            const std::lock_guard<std::mutex> lock(jobsLock);
+            shutdown = true;
+            jobsCond.notify_all();
+        }
+
+        if(threadWriter.joinable())
+            threadWriter.join();
+
+        if(threadReader.joinable())
+            threadReader.join();
+
+        workerKill();
+        jobs.clear();
     }
 };
 
@@ -88,9 +338,41 @@ void* storage_script_init(const JsonObject & config)
         return nullptr;
     }
 
+    ptr->worker = config.getBoolean("worker", false);
+    ptr->workerQueue = std::max(config.getInteger("worker:queue", 8), 1);
+
     DEBUG("params: " << "exec = " << ptr->command);
+
+    // worker mode: queued jobs are saved before the worker reads them, unique path per job
+    if(ptr->worker && ptr->format.find("${seq}") == std::string::npos)
+    {
+        auto dot = ptr->format.rfind('.');
+        auto dir = ptr->format.rfind('/');
+
+        if(dot == std::string::npos || (dir != std::string::npos && dot < dir))
+            dot = ptr->format.size();
+
+        ptr->format.insert(dot, "-${seq}");
+    }
+
     DEBUG("params: " << "filename = " << ptr->format);
 
+    ptr->formatTemplate = FormatTemplate(ptr->format);
+    DEBUG("params: " << "worker = " << (ptr->worker ? "true" : "false"));
+
+    if(ptr->worker)
+    {
+        DEBUG("params: " << "worker:queue = " << ptr->workerQueue);
+
+        if(! ptr->workerSpawn())
+        {
+            ptr->clear();
+            return nullptr;
+        }
+
+        ptr->workerStart();
+    }
+
     return ptr.release();
 }
 
@@ -117,13 +399,21 @@ int storage_script_store_action(void* ptr, const std::string & signal)
     if(true)
     {
         const std::lock_guard<std::mutex> lock(st->change);
-        st->filename = String::strftime(st->format);
+        st->filename = st->formatTemplate.render(st->sessionId, st->sessionName, st->worker ? ++st->workerSeq : 0);
+    }
 
-        if(0 < st->sessionId)
-            st->filename = String::replace(st->filename, "${sid}", st->sessionId);
-    
-        if(! st->sessionName.empty())
-            st->filename = String::replace(st->filename, "${session}", st->sessionName);
+    if(st->worker)
+    {
+        const std::lock_guard<std::mutex> lock(st->change);
+
+        // saved and sent from the writer thread
+        if(! st->workerPush(st->surface, st->filename))
+        {
+            ERROR("worker queue full, skip: " << st->filename);
+            return PluginResult::Failed;
+        }
+
+        return PluginResult::DefaultOk;
     }
 
     if(Systems::isFile(st->command))
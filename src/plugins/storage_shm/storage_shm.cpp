@@ -0,0 +1,253 @@
+/***************************************************************************
+ *   Copyright (C) 2022 by MultiCapture team <public.irkutsk@gmail.com>    *
+ *                                                                         *
+ *   Part of the MultiCapture engine:                                      *
+ *   https://github.com/AndreyBarmaley/multi-capture                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <mutex>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+
+#include "../../settings.h"
+#include "shm_frames.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const int storage_shm_version = 20220415;
+
+struct storage_shm_t
+{
+    int                debug;
+    std::string        name;
+    size_t             slots;
+    size_t             frameSize;
+    size_t             frames;
+    ShmFrames::Ring    ring;
+    Surface            surface;
+    std::mutex         change;
+
+    storage_shm_t() : debug(0), slots(4), frameSize(0), frames(0) {}
+    ~storage_shm_t()
+    {
+        clear();
+    }
+
+    void clear(void)
+    {
+        debug = 0;
+        slots = 4;
+        frameSize = 0;
+        frames = 0;
+        ring.close();
+        surface.reset();
+        name.clear();
+    }
+
+    bool publish(const Surface & sf)
+    {
+        auto ptr = sf.toSDLSurface();
+        const size_t length = static_cast<size_t>(ptr->pitch) * ptr->h;
+
+        // ring created from the first frame, recreated if the frame grows: readers reopen it
+        if(! ring.isOpen() || ring.frameSize() < length)
+        {
+            if(! ring.create(name, slots, std::max(frameSize, length)))
+                return false;
+
+            DEBUG("shared memory created: " << name << ", slots: " << slots << ", frame size: " << ring.frameSize());
+        }
+
+        ShmFrames::FrameHeader info;
+        info.width = ptr->w;
+        info.height = ptr->h;
+        info.pitch = ptr->pitch;
+        info.bitsPerPixel = ptr->format->BitsPerPixel;
+        info.rmask = ptr->format->Rmask;
+        info.gmask = ptr->format->Gmask;
+        info.bmask = ptr->format->Bmask;
+        info.amask = ptr->format->Amask;
+
+        // native surface format, single copy to the slot
+        std::memcpy(ring.writeBegin(info), ptr->pixels, length);
+        ring.writeCommit();
+
+        frames++;
+
+        if(4 < debug)
+            DEBUG("frame published, sequence: " << ring.sequence());
+
+        return true;
+    }
+};
+
+void* storage_shm_init(const JsonObject & config)
+{
+    VERBOSE("version: " << storage_shm_version);
+
+    auto ptr = std::make_unique<storage_shm_t>();
+
+    ptr->debug = config.getInteger("debug", 0);
+    ptr->name = config.getString("name");
+    ptr->slots = std::max(config.getInteger("slots", 4), 2);
+
+    // reserved slot size, avoid ring recreate for different frames
+    Size reserve = JsonUnpack::size(config, "reserve", Size(0, 0));
+    if(0 < reserve.w && 0 < reserve.h)
+        ptr->frameSize = reserve.w * reserve.h * 4;
+
+    if(ptr->name.empty())
+    {
+        ERROR("name param empty");
+        ptr->clear();
+        return nullptr;
+    }
+
+    // posix shm name
+    if(ptr->name.front() != '/')
+        ptr->name.insert(0, "/");
+
+    DEBUG("params: " << "name = " << ptr->name);
+    DEBUG("params: " << "slots = " << ptr->slots);
+
+    return ptr.release();
+}
+
+void storage_shm_quit(void* ptr)
+{
+    storage_shm_t* st = static_cast<storage_shm_t*>(ptr);
+    if(st->debug) DEBUG("version: " << storage_shm_version << ", frames: " << st->frames);
+
+    delete st;
+}
+
+// PluginResult::Reset, PluginResult::Failed, PluginResult::DefaultOk, PluginResult::NoAction
+int storage_shm_store_action(void* ptr, const std::string & signal)
+{
+    storage_shm_t* st = static_cast<storage_shm_t*>(ptr);
+    if(3 < st->debug) DEBUG("version: " << storage_shm_version);
+
+    // always store
+    return PluginResult::NoAction;
+}
+
+bool storage_shm_get_value(void* ptr, int type, void* val)
+{
+    switch(type)
+    {
+        case PluginValue::PluginName:
+            if(auto res = static_cast<std::string*>(val))
+            {
+                res->assign("storage_shm");
+                return true;
+            }
+            break;
+    
+        case PluginValue::PluginVersion:
+            if(auto res = static_cast<int*>(val))
+            {
+                *res = storage_shm_version;
+                return true;
+            }
+            break;
+
+        case PluginValue::PluginAPI:
+            if(auto res = static_cast<int*>(val))
+            {
+                *res = PLUGIN_API;
+                return true;
+            }
+            break;
+
+        case PluginValue::PluginType:
+            if(auto res = static_cast<int*>(val))
+            {
+                *res = PluginType::Storage;
+                return true;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if(ptr)
+    {
+        storage_shm_t* st = static_cast<storage_shm_t*>(ptr);
+        if(4 < st->debug)
+            DEBUG("version: " << storage_shm_version << ", type: " << type);
+    
+        switch(type)
+        {
+            case PluginValue::StorageLocation:
+                if(auto res = static_cast<std::string*>(val))
+                {
+                    res->assign(st->name);
+                    return true;
+                }
+                break;
+
+            case PluginValue::StorageSurface:
+                if(auto res = static_cast<Surface*>(val))
+                {
+                    const std::lock_guard<std::mutex> lock(st->change);
+                    *res = st->surface;
+                    return true;
+                }
+                break;
+
+            default: break;
+        }
+    }
+
+    return false;
+}
+
+bool storage_shm_set_value(void* ptr, int type, const void* val)
+{
+    storage_shm_t* st = static_cast<storage_shm_t*>(ptr);
+    if(4 < st->debug)
+        DEBUG("version: " << storage_shm_version << ", type: " << type);
+
+    switch(type)
+    {
+        case PluginValue::StorageSurface:
+            if(auto res = static_cast<const Surface*>(val))
+            {
+                if(! res->isValid())
+                    return false;
+
+                const std::lock_guard<std::mutex> lock(st->change);
+                st->surface = *res;
+
+                return st->publish(st->surface);
+            }
+            break;
+
+        default: break;
+    }
+
+    return false;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -95,6 +95,7 @@ struct storage_video_t
     std::string sessionName;
     std::string filename;
     std::string format;
+    FormatTemplate formatTemplate;
     std::string type;
     Size        geometry;
 
@@ -230,13 +231,7 @@ struct storage_video_t
 
     bool init_record(int width, int height, AVPixelFormat avPixelFormat)
     {
-        filename = String::strftime(format);
-
-        if(0 < sessionId)
-            filename = String::replace(filename, "${sid}", sessionId);
-
-        if(! sessionName.empty())
-            filename = String::replace(filename, "${session}", sessionName);
+        filename = formatTemplate.render(sessionId, sessionName);
 
         std::string dir = Systems::dirname(filename);
 
@@ -486,6 +481,8 @@ void* storage_video_init(const JsonObject & config)
         ptr->videoLength = 0;
 
     DEBUG("params: " << "filename = " << ptr->format);
+
+    ptr->formatTemplate = FormatTemplate(ptr->format);
     DEBUG("params: " << "record:sec = " << ptr->videoLength);
     DEBUG("params: " << "record:format = " << ptr->type);
     DEBUG("params: " << "record:fps = " << ptr->fps);
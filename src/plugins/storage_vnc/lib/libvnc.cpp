@@ -21,9 +21,15 @@
  ***************************************************************************/
 
 #include <cctype>
+#include <cstring>
 #include <exception>
 #include <algorithm>
 
+#if defined(__SSE2__) && (__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__)
+#include <emmintrin.h>
+#define LIBVNC_SSE2 1
+#endif
+
 #include "gnutls/gnutls.h"
 #include "gnutls/crypto.h"
 
@@ -284,6 +290,36 @@ namespace RFB
             case ENCODING_COMPRESS1:
                 return "ExtendedCompress1";
 
+            case ENCODING_QUALITY9:
+                return "ExtendedQuality9";
+
+            case ENCODING_QUALITY8:
+                return "ExtendedQuality8";
+
+            case ENCODING_QUALITY7:
+                return "ExtendedQuality7";
+
+            case ENCODING_QUALITY6:
+                return "ExtendedQuality6";
+
+            case ENCODING_QUALITY5:
+                return "ExtendedQuality5";
+
+            case ENCODING_QUALITY4:
+                return "ExtendedQuality4";
+
+            case ENCODING_QUALITY3:
+                return "ExtendedQuality3";
+
+            case ENCODING_QUALITY2:
+                return "ExtendedQuality2";
+
+            case ENCODING_QUALITY1:
+                return "ExtendedQuality1";
+
+            case ENCODING_QUALITY0:
+                return "ExtendedQuality0";
+
             case ENCODING_CONTINUOUS_UPDATES:
                 return "ExtendedContinuousUpdates";
 
@@ -315,6 +351,32 @@ namespace RFB
         return res;
     }
 
+    void Region::divideBlocks(const Region & rt, const Size & sz, std::vector<Region> & res)
+    {
+        int cw = sz.w > rt.w ? rt.w : sz.w;
+        int ch = sz.h > rt.h ? rt.h : sz.h;
+
+        for(uint16_t yy = 0; yy < rt.h; yy += ch)
+        {
+            for(uint16_t xx = 0; xx < rt.w; xx += cw)
+            {
+                uint16_t fixedw = std::min(rt.w - xx, cw);
+                uint16_t fixedh = std::min(rt.h - yy, ch);
+                res.emplace_back(rt.x + xx, rt.y + yy, fixedw, fixedh);
+            }
+        }
+    }
+
+    void Region::divideCounts(const Region & rt, uint16_t cols, uint16_t rows, std::vector<Region> & res)
+    {
+        if(cols == 0 || rows == 0)
+            throw std::runtime_error("Region::divideCounts: size empty");
+
+        uint16_t bw = rt.w <= cols ? 1 : rt.w / cols;
+        uint16_t bh = rt.h <= rows ? 1 : rt.h / rows;
+        divideBlocks(rt, Size(bw, bh), res);
+    }
+
     std::list<Region> Region::divideCounts(const Region & rt, uint16_t cols, uint16_t rows)
     {
         if(cols == 0 || rows == 0)
@@ -508,15 +570,269 @@ namespace RFB
     {
         if(pf != *this)
         {
-            uint32_t r = (pf.red(pixel) * redMax) / pf.redMax;
-            uint32_t g = (pf.green(pixel) * greenMax) / pf.greenMax;
-            uint32_t b = (pf.blue(pixel) * blueMax) / pf.blueMax;
+            uint32_t r = scaleComponent(pf.red(pixel), pf.redMax, redMax);
+            uint32_t g = scaleComponent(pf.green(pixel), pf.greenMax, greenMax);
+            uint32_t b = scaleComponent(pf.blue(pixel), pf.blueMax, blueMax);
             return (r << redShift) | (g << greenShift) | (b << blueShift);
         }
             
         return pixel;
     }
 
+    int maxBits(uint32_t max)
+    {
+        // 2^n - 1 only
+        return max && 0 == (max & (max + 1)) ? __builtin_popcount(max) : 0;
+    }
+
+    uint32_t PixelFormat::scaleComponent(uint32_t val, uint32_t srcMax, uint32_t dstMax)
+    {
+        if(srcMax == dstMax)
+            return val;
+
+        int srcBits = maxBits(srcMax);
+        int dstBits = maxBits(dstMax);
+
+        // narrowing: drop low bits
+        if(srcBits && dstBits && dstBits < srcBits)
+            return val >> (srcBits - dstBits);
+
+        return (val * dstMax) / srcMax;
+    }
+
+    /* PixelConverter */
+    PixelConverter::PixelConverter(const PixelFormat & src, const PixelFormat & dst)
+        : srcFormat(src), dstFormat(dst), kernel(KernelGeneric)
+    {
+        switch(dst.bitsPerPixel)
+        {
+            case 32:
+            case 16:
+            case 8:
+                break;
+
+            default:
+                throw std::runtime_error("PixelConverter: unknown client pixel format");
+        }
+
+        if(! dst.trueColor())
+            throw std::runtime_error("PixelConverter: unsupported pixel format");
+
+        if(!(src != dst))
+        {
+            if(src.bigEndian() == dst.bigEndian())
+                kernel = KernelCopy;
+            else
+            if(32 == src.bitsPerPixel)
+                kernel = KernelSwap32;
+
+            return;
+        }
+
+        if(32 != src.bitsPerPixel || 0xFF != src.redMax || 0xFF != src.greenMax || 0xFF != src.blueMax)
+            return;
+
+        for(uint32_t val = 0; val < 256; ++val)
+        {
+            redTable[val] = PixelFormat::scaleComponent(val, 0xFF, dst.redMax) << dst.redShift;
+            greenTable[val] = PixelFormat::scaleComponent(val, 0xFF, dst.greenMax) << dst.greenShift;
+            blueTable[val] = PixelFormat::scaleComponent(val, 0xFF, dst.blueMax) << dst.blueShift;
+        }
+
+        kernel = KernelTable;
+
+        // shift only kernels
+        if(maxBits(dst.redMax) && maxBits(dst.greenMax) && maxBits(dst.blueMax))
+        {
+            if(16 == dst.bitsPerPixel)
+                kernel = KernelPack16;
+            else
+            if(8 == dst.bitsPerPixel)
+                kernel = KernelPack8;
+        }
+    }
+
+    uint32_t PixelConverter::convert(uint32_t pixel) const
+    {
+        switch(kernel)
+        {
+            case KernelCopy:
+            case KernelSwap32:
+                return pixel;
+
+            case KernelGeneric:
+                return dstFormat.convertFrom(srcFormat, pixel);
+
+            default:
+                break;
+        }
+
+        return redTable[0xFF & (pixel >> srcFormat.redShift)] |
+               greenTable[0xFF & (pixel >> srcFormat.greenShift)] | blueTable[0xFF & (pixel >> srcFormat.blueShift)];
+    }
+
+    size_t PixelConverter::writePixel(uint32_t pixel, uint8_t* dst) const
+    {
+        pixel = convert(pixel);
+
+        switch(dstFormat.bitsPerPixel)
+        {
+            case 32:
+                if(dstFormat.bigEndian())
+                {
+                    dst[0] = pixel >> 24; dst[1] = pixel >> 16; dst[2] = pixel >> 8; dst[3] = pixel;
+                }
+                else
+                {
+                    dst[0] = pixel; dst[1] = pixel >> 8; dst[2] = pixel >> 16; dst[3] = pixel >> 24;
+                }
+                return 4;
+
+            case 16:
+                if(dstFormat.bigEndian())
+                {
+                    dst[0] = pixel >> 8; dst[1] = pixel;
+                }
+                else
+                {
+                    dst[0] = pixel; dst[1] = pixel >> 8;
+                }
+                return 2;
+
+            default:
+                break;
+        }
+
+        dst[0] = pixel;
+        return 1;
+    }
+
+    uint32_t readPixel(const uint8_t* ptr, int bpp)
+    {
+        switch(bpp)
+        {
+            case 32:
+            {
+                uint32_t res;
+                std::memcpy(& res, ptr, sizeof(res));
+                return res;
+            }
+
+            case 24:
+#if (__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__)
+                return (static_cast<uint32_t>(ptr[2]) << 16) | (static_cast<uint32_t>(ptr[1]) << 8) | ptr[0];
+#else
+                return (static_cast<uint32_t>(ptr[0]) << 16) | (static_cast<uint32_t>(ptr[1]) << 8) | ptr[2];
+#endif
+            case 16:
+            {
+                uint16_t res;
+                std::memcpy(& res, ptr, sizeof(res));
+                return res;
+            }
+
+            default:
+                break;
+        }
+
+        return *ptr;
+    }
+
+#ifdef LIBVNC_SSE2
+    inline __m128i packComponents(__m128i src, const PixelFormat & sf, const PixelFormat & df)
+    {
+        auto comp = [&](int sshift, int dmax, int dshift)
+        {
+            auto val = _mm_srl_epi32(src, _mm_cvtsi32_si128(sshift + 8 - maxBits(dmax)));
+            val = _mm_and_si128(val, _mm_set1_epi32(dmax));
+            return _mm_sll_epi32(val, _mm_cvtsi32_si128(dshift));
+        };
+
+        return _mm_or_si128(comp(sf.redShift, df.redMax, df.redShift),
+                _mm_or_si128(comp(sf.greenShift, df.greenMax, df.greenShift), comp(sf.blueShift, df.blueMax, df.blueShift)));
+    }
+
+    inline __m128i swapBytes16(__m128i val)
+    {
+        return _mm_or_si128(_mm_slli_epi16(val, 8), _mm_srli_epi16(val, 8));
+    }
+#endif
+
+    size_t PixelConverter::convertRow(const uint8_t* src, size_t pixels, uint8_t* dst) const
+    {
+        const size_t srcBpp = srcFormat.bytePerPixel();
+        const size_t dstBpp = dstFormat.bytePerPixel();
+        size_t pos = 0;
+
+        switch(kernel)
+        {
+            case KernelCopy:
+                std::memcpy(dst, src, pixels * dstBpp);
+                return pixels * dstBpp;
+
+            case KernelSwap32:
+#ifdef LIBVNC_SSE2
+                for(; pos + 4 <= pixels; pos += 4)
+                {
+                    auto val = swapBytes16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos * 4)));
+                    val = _mm_shufflehi_epi16(_mm_shufflelo_epi16(val, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos * 4), val);
+                }
+#endif
+                for(; pos < pixels; ++pos)
+                {
+                    auto ptr = src + pos * 4;
+                    auto res = dst + pos * 4;
+                    res[0] = ptr[3]; res[1] = ptr[2]; res[2] = ptr[1]; res[3] = ptr[0];
+                }
+                return pixels * 4;
+
+#ifdef LIBVNC_SSE2
+            case KernelPack16:
+            {
+                // signed pack bias
+                const __m128i bias32 = _mm_set1_epi32(0x8000);
+                const __m128i bias16 = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+
+                for(; pos + 8 <= pixels; pos += 8)
+                {
+                    auto p0 = packComponents(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos * 4)), srcFormat, dstFormat);
+                    auto p1 = packComponents(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos * 4 + 16)), srcFormat, dstFormat);
+                    auto val = _mm_add_epi16(_mm_packs_epi32(_mm_sub_epi32(p0, bias32), _mm_sub_epi32(p1, bias32)), bias16);
+
+                    if(dstFormat.bigEndian())
+                        val = swapBytes16(val);
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos * 2), val);
+                }
+                break;
+            }
+
+            case KernelPack8:
+                for(; pos + 16 <= pixels; pos += 16)
+                {
+                    auto p0 = packComponents(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos * 4)), srcFormat, dstFormat);
+                    auto p1 = packComponents(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos * 4 + 16)), srcFormat, dstFormat);
+                    auto p2 = packComponents(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos * 4 + 32)), srcFormat, dstFormat);
+                    auto p3 = packComponents(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos * 4 + 48)), srcFormat, dstFormat);
+                    auto val = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), val);
+                }
+                break;
+#endif
+
+            default:
+                break;
+        }
+
+        // scalar tail
+        for(; pos < pixels; ++pos)
+            writePixel(readPixel(src + pos * srcBpp, srcFormat.bitsPerPixel), dst + pos * dstBpp);
+
+        return pixels * dstBpp;
+    }
+
     fbinfo_t::fbinfo_t(const Size & fbsz, const PixelFormat & fmt)
         : allocated(true), pitch(0), buffer(nullptr), format(fmt)
     {
@@ -547,6 +863,95 @@ namespace RFB
         return it != end() ? (*it).first : 0;
     }
 
+    uint32_t PixelPalette::maxWeightPixel(void) const
+    {
+        auto it = std::max_element(weights.begin(), weights.begin() + count);
+        return it != weights.begin() + count ? pixels[std::distance(weights.begin(), it)] : 0;
+    }
+
+    /* typed row access */
+    template<int Bpp>
+    inline uint32_t readPixelBpp(const uint8_t* ptr)
+    {
+        if constexpr(Bpp == 4)
+        {
+            uint32_t res;
+            std::memcpy(& res, ptr, sizeof(res));
+            return res;
+        }
+        else
+        if constexpr(Bpp == 2)
+        {
+            uint16_t res;
+            std::memcpy(& res, ptr, sizeof(res));
+            return res;
+        }
+        else
+        if constexpr(Bpp == 3)
+        {
+#if (__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__)
+            return (static_cast<uint32_t>(ptr[2]) << 16) | (static_cast<uint32_t>(ptr[1]) << 8) | ptr[0];
+#else
+            return (static_cast<uint32_t>(ptr[0]) << 16) | (static_cast<uint32_t>(ptr[1]) << 8) | ptr[2];
+#endif
+        }
+
+        return *ptr;
+    }
+
+    /// scan region rows as pixel runs: func(pixel, length, row)
+    template<int Bpp, typename Func>
+    bool scanRunsBpp(const FrameBuffer & fb, const Region & reg, Func func)
+    {
+        for(int row = 0; row < reg.h; ++row)
+        {
+            auto ptr = fb.rowData(reg, row);
+            auto end = ptr + reg.w * Bpp;
+            uint32_t pixel = readPixelBpp<Bpp>(ptr);
+            uint32_t length = 1;
+
+            for(ptr += Bpp; ptr < end; ptr += Bpp)
+            {
+                auto pixel2 = readPixelBpp<Bpp>(ptr);
+
+                if(pixel2 == pixel)
+                    length++;
+                else
+                {
+                    if(! func(pixel, length, row))
+                        return false;
+
+                    pixel = pixel2;
+                    length = 1;
+                }
+            }
+
+            if(! func(pixel, length, row))
+                return false;
+        }
+
+        return true;
+    }
+
+    template<typename Func>
+    bool scanRuns(const FrameBuffer & fb, const Region & reg, Func func)
+    {
+        if(reg.isEmpty())
+            return true;
+
+        switch(fb.bytePerPixel())
+        {
+            case 4: return scanRunsBpp<4>(fb, reg, func);
+            case 3: return scanRunsBpp<3>(fb, reg, func);
+            case 2: return scanRunsBpp<2>(fb, reg, func);
+            case 1: return scanRunsBpp<1>(fb, reg, func);
+            default: break;
+        }
+
+        throw std::runtime_error(std::string("FrameBuffer::scanRuns: unknown bpp: ").append(std::to_string(fb.bitsPerPixel())));
+        return false;
+    }
+
     /* FrameBuffer */
     FrameBuffer::FrameBuffer(const Region & reg, const FrameBuffer & fb)
         : fbptr(fb.fbptr), fbreg(reg.toPoint() + fb.fbreg.toPoint(), reg.toSize()), owner(false)
@@ -734,6 +1139,32 @@ namespace RFB
         return res;
     }
 
+    void FrameBuffer::toRLE(const Region & reg0, std::vector<PixelLength> & res) const
+    {
+        res.clear();
+
+        scanRuns(*this, Region(0, 0, fbreg.w, fbreg.h).intersected(reg0), [&](uint32_t pixel, uint32_t length, int row)
+        {
+            res.emplace_back(pixel, length);
+            return true;
+        });
+    }
+
+    bool FrameBuffer::pixelPalette(const Region & reg0, PixelPalette & pal) const
+    {
+        pal.count = 0;
+
+        return scanRuns(*this, Region(0, 0, fbreg.w, fbreg.h).intersected(reg0), [&](uint32_t pixel, uint32_t length, int row)
+        {
+            return pal.append(pixel, length);
+        });
+    }
+
+    const uint8_t* FrameBuffer::rowData(const Region & reg, size_t row) const
+    {
+        return pitchData(reg.y + row) + reg.x * bytePerPixel();
+    }
+
     void FrameBuffer::blitRegion(const FrameBuffer & fb, const Region & reg, const Point & pos)
     {
         auto dst = Region(pos, reg.toSize()).intersected(region());
@@ -774,10 +1205,10 @@ namespace RFB
 
     bool FrameBuffer::allOfPixel(uint32_t pixel, const Region & reg) const
     {
-        for(auto coord = PointIterator(0, 0, reg.toSize()); coord.isValid(); ++coord)
-            if(pixel != this->pixel(reg.topLeft() + coord)) return false;
-
-        return true;
+        return scanRuns(*this, Region(0, 0, fbreg.w, fbreg.h).intersected(reg), [=](uint32_t pixel2, uint32_t length, int row)
+        {
+            return pixel2 == pixel;
+        });
     }
 
     Color FrameBuffer::color(const Point & pos) const
@@ -24,6 +24,7 @@
 #define _LIBVNC_
 
 #include <list>
+#include <array>
 #include "libswe.h"
 
 namespace Tools
@@ -104,6 +105,7 @@ namespace RFB
     const int SERVER_SET_COLOURMAP = 1;
     const int SERVER_BELL = 2;
     const int SERVER_CUT_TEXT = 3;
+    const int SERVER_END_CONTINUOUS_UPDATES = 150;
 
     // RFB protocol constants
     const int ENCODING_RAW = 0;
@@ -126,6 +128,15 @@ namespace RFB
     const int HEXTILE_ZLIBRAW = 32;
     const int HEXTILE_ZLIB = 64;
 
+    // tight constants
+    const int TIGHT_FILL = 0x08;
+    const int TIGHT_JPEG = 0x09;
+    const int TIGHT_PNG = 0x0A;
+    const int TIGHT_EXPLICIT_FILTER = 0x04;
+    const int TIGHT_FILTER_COPY = 0;
+    const int TIGHT_FILTER_PALETTE = 1;
+    const int TIGHT_FILTER_GRADIENT = 2;
+
     // pseudo encodings
     const int ENCODING_DESKTOP_SIZE = -223;
     const int ENCODING_EXT_DESKTOP_SIZE = -308;
@@ -140,6 +151,16 @@ namespace RFB
     const int ENCODING_COMPRESS3 = -253;
     const int ENCODING_COMPRESS2 = -254;
     const int ENCODING_COMPRESS1 = -255;
+    const int ENCODING_QUALITY9 = -23;
+    const int ENCODING_QUALITY8 = -24;
+    const int ENCODING_QUALITY7 = -25;
+    const int ENCODING_QUALITY6 = -26;
+    const int ENCODING_QUALITY5 = -27;
+    const int ENCODING_QUALITY4 = -28;
+    const int ENCODING_QUALITY3 = -29;
+    const int ENCODING_QUALITY2 = -30;
+    const int ENCODING_QUALITY1 = -31;
+    const int ENCODING_QUALITY0 = -32;
 
     std::string encodingName(int type);
 
@@ -185,6 +206,8 @@ namespace RFB
 
         static std::list<Region> divideBlocks(const Region & rt, const Size &);
         static std::list<Region> divideCounts(const Region & rt, uint16_t cols, uint16_t rows);
+        static void              divideBlocks(const Region & rt, const Size &, std::vector<Region> &);
+        static void              divideCounts(const Region & rt, uint16_t cols, uint16_t rows, std::vector<Region> &);
         static bool              intersects(const Region &, const Region &);
         static bool              intersection(const Region &, const Region &, Region* res);
     };
@@ -224,6 +247,52 @@ namespace RFB
         int             maxWeightPixel(void) const;
     };
 
+    /// @brief: fixed size palette with weights, tile analysis without allocation
+    struct PixelPalette
+    {
+        enum { MaxSize = 128 };
+
+        std::array<uint32_t, MaxSize> pixels;
+        std::array<uint32_t, MaxSize> weights;
+        size_t          count;
+        size_t          limit;
+
+        PixelPalette(size_t lim = 16) : count(0), limit(std::min(lim, static_cast<size_t>(MaxSize))) {}
+
+        void            reset(size_t lim) { count = 0; limit = std::min(lim, static_cast<size_t>(MaxSize)); }
+        size_t          size(void) const { return count; }
+        bool            empty(void) const { return 0 == count; }
+
+        int             index(uint32_t pixel) const
+        {
+            for(size_t it = 0; it < count; ++it)
+                if(pixels[it] == pixel) return it;
+
+            return -1;
+        }
+
+        bool            append(uint32_t pixel, uint32_t weight)
+        {
+            int pos = index(pixel);
+
+            if(0 <= pos)
+                weights[pos] += weight;
+            else
+            {
+                if(count == limit)
+                    return false;
+
+                pixels[count] = pixel;
+                weights[count] = weight;
+                count++;
+            }
+
+            return true;
+        }
+
+        uint32_t        maxWeightPixel(void) const;
+    };
+
     struct PixelFormat
     {
         uint8_t         bitsPerPixel;
@@ -263,6 +332,31 @@ namespace RFB
         Color           color(int pixel) const;
         uint32_t        pixel(const Color & col) const;
         uint32_t        convertFrom(const PixelFormat & pf, uint32_t pixel) const;
+
+        static uint32_t scaleComponent(uint32_t val, uint32_t srcMax, uint32_t dstMax);
+    };
+
+    /// @brief: precalculated pixel converter, row kernels for 32bpp source
+    struct PixelConverter
+    {
+        enum { KernelCopy, KernelSwap32, KernelPack16, KernelPack8, KernelTable, KernelGeneric };
+
+        PixelFormat     srcFormat;
+        PixelFormat     dstFormat;
+        int             kernel;
+
+        std::array<uint32_t, 256> redTable;
+        std::array<uint32_t, 256> greenTable;
+        std::array<uint32_t, 256> blueTable;
+
+        PixelConverter() : kernel(KernelGeneric) {}
+        PixelConverter(const PixelFormat & src, const PixelFormat & dst);
+
+        bool            isCopy(void) const { return kernel == KernelCopy; }
+
+        uint32_t        convert(uint32_t pixel) const;
+        size_t          writePixel(uint32_t pixel, uint8_t* dst) const;
+        size_t          convertRow(const uint8_t* src, size_t pixels, uint8_t* dst) const;
     };
 
     struct fbinfo_t
@@ -328,6 +422,10 @@ namespace RFB
         std::list<PixelLength> toRLE(const Region &) const;
         bool            allOfPixel(uint32_t pixel, const Region &) const;
 
+        void            toRLE(const Region &, std::vector<PixelLength> &) const;
+        bool            pixelPalette(const Region &, PixelPalette &) const;
+        const uint8_t*  rowData(const Region &, size_t row) const;
+
         size_t          width(void) const;
         size_t          height(void) const;
         size_t          pitchSize(void) const;
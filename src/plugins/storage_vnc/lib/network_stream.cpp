@@ -20,7 +20,22 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+
 #include <array>
+#include <climits>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <stdexcept>
 #include "network_stream.h"
 
@@ -105,47 +120,50 @@ namespace Network
     uint16_t BaseStream::recvIntLE16(void) const
     {
         uint16_t v = 0;
-        recvRaw(& v, sizeof(v));
+        if(! recvWindow(& v, sizeof(v))) recvRaw(& v, sizeof(v));
         return SDL_SwapLE16(v);
     }
 
     uint32_t BaseStream::recvIntLE32(void) const
     {
         uint32_t v = 0;
-        recvRaw(& v, sizeof(v));
+        if(! recvWindow(& v, sizeof(v))) recvRaw(& v, sizeof(v));
         return SDL_SwapLE32(v);
     }
 
     uint64_t BaseStream::recvIntLE64(void) const
     {
         uint64_t v = 0;
-        recvRaw(& v, sizeof(v));
+        if(! recvWindow(& v, sizeof(v))) recvRaw(& v, sizeof(v));
         return SDL_SwapLE64(v);
     }
 
     uint16_t BaseStream::recvIntBE16(void) const
     {
         uint16_t v = 0;
-        recvRaw(& v, sizeof(v));
+        if(! recvWindow(& v, sizeof(v))) recvRaw(& v, sizeof(v));
         return SDL_SwapBE16(v);
     }
 
     uint32_t BaseStream::recvIntBE32(void) const
     {
         uint32_t v = 0;
-        recvRaw(& v, sizeof(v));
+        if(! recvWindow(& v, sizeof(v))) recvRaw(& v, sizeof(v));
         return SDL_SwapBE32(v);
     }
 
     uint64_t BaseStream::recvIntBE64(void) const
     {
         uint64_t v = 0;
-        recvRaw(& v, sizeof(v));
+        if(! recvWindow(& v, sizeof(v))) recvRaw(& v, sizeof(v));
         return SDL_SwapBE64(v);
     }
 
     uint8_t BaseStream::recvInt8(void) const
     {
+        if(recvHead < recvTail)
+            return *recvHead++;
+
         uint8_t v = 0;
         recvRaw(& v, sizeof(v));
         return v;
@@ -180,14 +198,30 @@ namespace Network
 
     void BaseStream::recvSkip(size_t length) const
     {
-        while(length--)
-            recvInt8();
+        auto len = std::min(length, recvBuffered());
+        recvHead += len;
+        length -= len;
+
+        std::array<uint8_t, 256> tmp;
+
+        while(length)
+        {
+            len = std::min(length, tmp.size());
+            recvRaw(tmp.data(), len);
+            length -= len;
+        }
     }
 
     BaseStream & BaseStream::sendZero(size_t length)
     {
-        while(length--)
-            sendInt8(0);
+        const std::array<uint8_t, 256> zero = { 0 };
+
+        while(length)
+        {
+            auto len = std::min(length, zero.size());
+            sendRaw(zero.data(), len);
+            length -= len;
+        }
 
         return *this;
     }
@@ -210,7 +244,15 @@ namespace Network
         res.reserve(64);
 
         while(hasInput())
-            res.push_back(recvInt8());
+        {
+            if(recvHead < recvTail)
+            {
+                res.insert(res.end(), recvHead, recvTail);
+                recvHead = recvTail;
+            }
+            else
+                res.push_back(recvInt8());
+        }
 
         return res;
     }
@@ -228,15 +270,282 @@ namespace Network
         return std::string(buf.begin(), buf.end());
     }
 
-    /* TCPStream */
-    TCPStream::TCPStream(TCPsocket val) : sock(val)
+    /* BufferChain */
+    BufferChain::BufferChain(size_t blocksz, size_t poollim)
+        : blockSize(blocksz), poolLimit(poollim), length(0), released(0), pinned(std::string::npos)
     {
-        sdset = SDLNet_AllocSocketSet(1);
+    }
 
-        if(sock)
-            SDLNet_TCP_AddSocket(sdset, sock);
+    void BufferChain::appendBlock(void)
+    {
+        if(pool.empty())
+            blocks.emplace_back(blockSize);
+        else
+            blocks.splice(blocks.end(), pool, pool.begin());
+    }
+
+    void BufferChain::appendSlow(const uint8_t* ptr, size_t len)
+    {
+        while(len)
+        {
+            if(blocks.empty() || 0 == blocks.back().free())
+                appendBlock();
+
+            auto & block = blocks.back();
+            auto part = std::min(len, block.free());
+
+            std::memcpy(block.data.data() + block.end, ptr, part);
+            block.end += part;
+            length += part;
+            ptr += part;
+            len -= part;
+        }
+    }
+
+    void BufferChain::appendZero(size_t len)
+    {
+        while(len)
+        {
+            if(blocks.empty() || 0 == blocks.back().free())
+                appendBlock();
+
+            auto & block = blocks.back();
+            auto part = std::min(len, block.free());
 
-        buf.reserve(2048);
+            std::memset(block.data.data() + block.end, 0, part);
+            block.end += part;
+            length += part;
+            len -= part;
+        }
+    }
+
+    void BufferChain::consume(size_t len)
+    {
+        while(len && ! blocks.empty())
+        {
+            auto & block = blocks.front();
+            auto part = std::min(len, block.size());
+
+            block.begin += part;
+            length -= part;
+            released += part;
+            len -= part;
+
+            // release sent block
+            if(block.begin == block.end)
+            {
+                block.begin = block.end = 0;
+
+                if(pool.size() < poolLimit)
+                    pool.splice(pool.end(), blocks, blocks.begin());
+                else
+                    blocks.pop_front();
+            }
+        }
+    }
+
+    void BufferChain::clear(void)
+    {
+        consume(length);
+    }
+
+    size_t BufferChain::fullBlocksSize(void) const
+    {
+        size_t res = 0;
+
+        for(auto & block : blocks)
+            if(0 == block.free()) res += block.size();
+
+        return res;
+    }
+
+    void BufferChain::iovecs(std::vector<struct iovec> & res, bool fullBlocksOnly) const
+    {
+        size_t pos = released;
+        res.clear();
+
+        for(auto & block : blocks)
+        {
+            if(fullBlocksOnly && block.free())
+                break;
+
+            // wait patch
+            if(pinned < pos + block.size())
+                break;
+
+            pos += block.size();
+
+            if(block.size())
+                res.push_back({ const_cast<uint8_t*>(block.data.data() + block.begin), block.size() });
+        }
+    }
+
+    uint8_t* BufferChain::tail(size_t & free)
+    {
+        if(blocks.empty() || 0 == blocks.back().free())
+            appendBlock();
+
+        auto & block = blocks.back();
+        free = block.free();
+        return block.data.data() + block.end;
+    }
+
+    void BufferChain::commit(size_t len)
+    {
+        if(len)
+        {
+            blocks.back().end += len;
+            length += len;
+        }
+    }
+
+    size_t BufferChain::reserve(size_t len)
+    {
+        size_t pos = released + length;
+
+        if(pinned == std::string::npos)
+            pinned = pos;
+
+        appendZero(len);
+        return pos;
+    }
+
+    void BufferChain::patch(size_t pos, const void* ptr, size_t len)
+    {
+        auto src = static_cast<const uint8_t*>(ptr);
+        size_t start = released;
+
+        for(auto & block : blocks)
+        {
+            while(len && start <= pos && pos < start + block.size())
+            {
+                block.data[block.begin + pos - start] = *src++;
+                pos++;
+                len--;
+            }
+
+            start += block.size();
+        }
+
+        if(len)
+            throw std::runtime_error("BufferChain::patch: position out of range");
+
+        pinned = std::string::npos;
+    }
+
+    std::vector<uint8_t> BufferChain::toVector(void) const
+    {
+        std::vector<uint8_t> res;
+        res.reserve(length);
+
+        for(auto & block : blocks)
+            res.insert(res.end(), block.data.begin() + block.begin, block.data.begin() + block.end);
+
+        return res;
+    }
+
+    /* EventLoop */
+    EventLoop::EventLoop() : epfd(-1), evfd(-1)
+    {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if(0 > epfd)
+            throw std::runtime_error(std::string("EventLoop: epoll_create failed, error: ").append(strerror(errno)));
+
+        evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(0 > evfd)
+        {
+            // destructor not called
+            int err = errno;
+            ::close(epfd);
+            throw std::runtime_error(std::string("EventLoop: eventfd failed, error: ").append(strerror(err)));
+        }
+
+        // wakeup marker: ptr is this
+        add(evfd, EPOLLIN, this);
+    }
+
+    EventLoop::~EventLoop()
+    {
+        if(0 <= evfd) ::close(evfd);
+        if(0 <= epfd) ::close(epfd);
+    }
+
+    bool EventLoop::add(int fd, uint32_t events, void* ptr)
+    {
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.ptr = ptr;
+
+        if(0 > epoll_ctl(epfd, EPOLL_CTL_ADD, fd, & ev))
+        {
+            ERROR("epoll_ctl add failed, error: " << strerror(errno));
+            return false;
+        }
+
+        return true;
+    }
+
+    bool EventLoop::modify(int fd, uint32_t events, void* ptr)
+    {
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.ptr = ptr;
+
+        if(0 > epoll_ctl(epfd, EPOLL_CTL_MOD, fd, & ev))
+        {
+            ERROR("epoll_ctl modify failed, error: " << strerror(errno));
+            return false;
+        }
+
+        return true;
+    }
+
+    bool EventLoop::remove(int fd)
+    {
+        return 0 == epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    int EventLoop::wait(std::vector<struct epoll_event> & events, int ms)
+    {
+        if(events.empty())
+            events.resize(16);
+
+        int res = epoll_wait(epfd, events.data(), events.size(), ms);
+
+        if(0 > res)
+        {
+            if(errno == EINTR)
+                return 0;
+
+            throw std::runtime_error(std::string("EventLoop::wait: epoll_wait failed, error: ").append(strerror(errno)));
+        }
+
+        // skip wakeup events
+        auto last = std::remove_if(events.begin(), events.begin() + res, [this](auto & ev)
+        {
+            return ev.data.ptr == this;
+        });
+
+        if(last != events.begin() + res)
+        {
+            uint64_t counter = 0;
+            while(0 < ::read(evfd, & counter, sizeof(counter)));
+        }
+
+        return std::distance(events.begin(), last);
+    }
+
+    void EventLoop::wakeup(void)
+    {
+        uint64_t counter = 1;
+        if(0 > ::write(evfd, & counter, sizeof(counter)) && errno != EAGAIN)
+            ERROR("eventfd write failed, error: " << strerror(errno));
+    }
+
+    /* TCPStream */
+    TCPStream::TCPStream(int fd) : sock(-1), timeout(30000), highWater(1024 * 1024), waitOutput(0)
+    {
+        open(fd);
     }
 
     TCPStream::~TCPStream()
@@ -244,16 +553,20 @@ namespace Network
         close();
     }
 
-    bool TCPStream::open(TCPsocket val)
+    bool TCPStream::open(int fd)
     {
-        if(sock)
-            SDLNet_TCP_Close(sock);
+        if(0 <= sock)
+            ::close(sock);
 
-        sock = val;
+        sock = fd;
 
-        if(sock)
+        if(0 <= sock)
         {
-            SDLNet_TCP_AddSocket(sdset, sock);
+            int flags = fcntl(sock, F_GETFL, 0);
+            if(0 > fcntl(sock, F_SETFL, flags | O_NONBLOCK))
+                ERROR("fcntl failed, error: " << strerror(errno));
+
+            setNoDelay(true);
             return true;
         }
 
@@ -262,91 +575,275 @@ namespace Network
 
     void TCPStream::close(void)
     {
-        if(sdset)
+        if(0 <= sock)
         {
-            if(sock) SDLNet_TCP_DelSocket(sdset, sock);
+            ::close(sock);
+            sock = -1;
+        }
+
+        recvHead = recvTail = nullptr;
+    }
+
+    void TCPStream::shutdown(void)
+    {
+        if(0 <= sock)
+            ::shutdown(sock, SHUT_RDWR);
+    }
 
-            SDLNet_FreeSocketSet(sdset);
-            sdset = nullptr;
+    std::string TCPStream::peerAddress(void) const
+    {
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        std::array<char, INET6_ADDRSTRLEN> str = { 0 };
+
+        if(0 <= sock && 0 == getpeername(sock, reinterpret_cast<struct sockaddr*>(& addr), & len))
+        {
+            if(addr.ss_family == AF_INET)
+                inet_ntop(AF_INET, & reinterpret_cast<struct sockaddr_in*>(& addr)->sin_addr, str.data(), str.size());
+            else
+            if(addr.ss_family == AF_INET6)
+                inet_ntop(AF_INET6, & reinterpret_cast<struct sockaddr_in6*>(& addr)->sin6_addr, str.data(), str.size());
         }
 
-        if(sock)
+        return std::string(str.data());
+    }
+
+    void TCPStream::setNoDelay(bool f)
+    {
+        int val = f ? 1 : 0;
+        if(0 <= sock)
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, & val, sizeof(val));
+    }
+
+    void TCPStream::setCork(bool f)
+    {
+#ifdef TCP_CORK
+        int val = f ? 1 : 0;
+        if(0 <= sock)
+            setsockopt(sock, IPPROTO_TCP, TCP_CORK, & val, sizeof(val));
+#endif
+    }
+
+    bool TCPStream::waitEvent(short events, int ms) const
+    {
+        struct pollfd pfd = { sock, events, 0 };
+
+        while(true)
         {
-            SDLNet_TCP_Close(sock);
-            sock = nullptr;
+            int res = poll(& pfd, 1, ms);
+
+            if(0 < res)
+                return true;
+
+            if(0 == res)
+                return false;
+
+            if(errno != EINTR)
+                throw std::runtime_error(std::string("TCPStream::waitEvent: poll failed, error: ").append(strerror(errno)));
         }
+
+        return false;
+    }
+
+    bool TCPStream::waitInput(int ms) const
+    {
+        return 0 <= sock && waitEvent(POLLIN, ms);
     }
 
     bool TCPStream::hasInput(void) const
     {
-        return sock && 0 < SDLNet_CheckSockets(sdset, 1) && 0 < SDLNet_SocketReady(sock);
+        return recvHead < recvTail || waitInput(0);
+    }
+
+    void TCPStream::setRecvBuffer(size_t sz)
+    {
+        // not thread safe, set before reading
+        recvBuf.resize(sz);
+        recvHead = recvTail = nullptr;
     }
 
     void TCPStream::recvRaw(void* ptr, size_t len) const
     {
-        size_t total = 0;
-        while(total < len)
+        auto buf = reinterpret_cast<uint8_t*>(ptr);
+
+        // buffered part first
+        size_t total = std::min(len, recvBuffered());
+
+        if(total)
         {
-            auto buf = reinterpret_cast<uint8_t*>(ptr);
-            int rcv = SDLNet_TCP_Recv(sock, buf + total, len - total);
-        
-            if(0 >= rcv)
-                throw std::runtime_error(SWE::StringFormat("TCPStream::recvRaw: read bytes: %1, expected: %2, error: %3").arg(total).arg(len).arg(SDL_GetError()));
+            std::memcpy(buf, recvHead, total);
+            recvHead += total;
+        }
 
-            total += rcv;
+        if(total == len)
+            return;
 
-            if(total < len)
-                SDL_Delay(1);
+        // small reads refill the buffer, large reads go straight to destination
+        if(len - total < recvBuf.size() / 2)
+        {
+            auto rcv = recvSocket(recvBuf.data(), len - total, recvBuf.size());
+
+            std::memcpy(buf + total, recvBuf.data(), len - total);
+            recvHead = recvBuf.data() + (len - total);
+            recvTail = recvBuf.data() + rcv;
         }
+        else
+            recvSocket(buf + total, len - total, len - total);
+    }
+
+    size_t TCPStream::recvSocket(uint8_t* buf, size_t len, size_t capacity) const
+    {
+        size_t total = 0;
+
+        while(total < len)
+        {
+            ssize_t rcv = ::recv(sock, buf + total, capacity - total, 0);
+
+            if(0 < rcv)
+            {
+                total += rcv;
+                continue;
+            }
+
+            if(0 > rcv && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            {
+                if(! waitEvent(POLLIN, timeout))
+                    throw std::runtime_error(SWE::StringFormat("TCPStream::recvRaw: timeout, read bytes: %1, expected: %2").arg(total).arg(len));
+                continue;
+            }
+
+            throw std::runtime_error(SWE::StringFormat("TCPStream::recvRaw: read bytes: %1, expected: %2, error: %3").arg(total).arg(len).arg(rcv ? strerror(errno) : "connection closed"));
+        }
+
+        return total;
     }
 
     void TCPStream::sendRaw(const void* ptr, size_t len)
     {
         if(ptr && len)
         {
-            auto it = static_cast<const uint8_t*>(ptr);
-            buf.insert(buf.end(), it, it + len);
+            buf.append(ptr, len);
+            sendOverflow();
         }
     }
 
-    void TCPStream::sendFlush(void)
+    void TCPStream::sendOverflow(void)
     {
-        if(buf.size())
+        // high-water mark: send complete blocks, keep memory bounded
+        if(highWater < buf.size())
+            sendBlocks(true);
+    }
+
+    std::chrono::microseconds TCPStream::takeWaitOutput(void)
+    {
+        auto res = waitOutput;
+        waitOutput = std::chrono::microseconds(0);
+        return res;
+    }
+
+    void TCPStream::sendVector(struct iovec* iov, int counts)
+    {
+        while(0 < counts)
         {
-            auto real = SDLNet_TCP_Send(sock, buf.data(), buf.size());
+            ssize_t real = ::writev(sock, iov, std::min(counts, IOV_MAX));
+
+            if(0 > real)
+            {
+                if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    // output stalled: network slower than encoder
+                    auto start = std::chrono::steady_clock::now();
+
+                    if(! waitEvent(POLLOUT, timeout))
+                        throw std::runtime_error("TCPStream::sendVector: timeout");
+
+                    waitOutput += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                    continue;
+                }
+
+                throw std::runtime_error(std::string("TCPStream::sendVector: error: ").append(strerror(errno)));
+            }
+
+            // skip complete parts, fixed partial
+            while(0 < counts && static_cast<size_t>(real) >= iov->iov_len)
+            {
+                real -= iov->iov_len;
+                iov++;
+                counts--;
+            }
+
+            if(0 < counts && 0 < real)
+            {
+                iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + real;
+                iov->iov_len -= real;
+            }
+        }
+    }
+
+    void TCPStream::sendBlocks(bool fullBlocksOnly)
+    {
+        buf.iovecs(iov, fullBlocksOnly);
 
-            if(real != buf.size())
-                throw std::runtime_error(SWE::StringFormat("TCPStream::sendFlush: write bytes: %1, expected: %2").arg(real).arg(buf.size()));
+        if(iov.size())
+        {
+            size_t total = 0;
+            for(auto & part : iov)
+                total += part.iov_len;
 
-            buf.clear();
+            sendVector(iov.data(), iov.size());
+            buf.consume(total);
         }
     }
 
+    void TCPStream::sendFlush(void)
+    {
+        if(buf.size())
+            sendBlocks(false);
+    }
+
     /* TCPServer */
-    TCPsocket TCPServer::accept(void)
+    int TCPServer::accept(void)
     {
-        return sock ? SDLNet_TCP_Accept(sock) : nullptr;
+        if(0 > sock)
+            return -1;
+
+        int fd = ::accept4(sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if(0 > fd && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            ERROR("accept failed, error: " << strerror(errno));
+
+        return fd;
     }
 
     bool TCPServer::listen(int port)
     {
-        IPaddress ip;
-        
-        if(0 > SDLNet_ResolveHost(&ip, nullptr, port))
+        close();
+
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(0 > fd)
         {
-            ERROR(SDLNet_GetError());
+            ERROR("socket failed, error: " << strerror(errno));
             return false;
         }
-        
-        close();
-        sock = SDLNet_TCP_Open(&ip);
-        
-        if(! sock)
+
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, & reuse, sizeof(reuse));
+
+        struct sockaddr_in addr;
+        std::memset(& addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+
+        if(0 > ::bind(fd, reinterpret_cast<struct sockaddr*>(& addr), sizeof(addr)) ||
+            0 > ::listen(fd, SOMAXCONN))
         {
-            ERROR(SDLNet_GetError());
+            ERROR("bind failed, port: " << port << ", error: " << strerror(errno));
+            ::close(fd);
             return false;
         }
-                
+
+        sock = fd;
         return true;
     }
 
@@ -358,15 +855,57 @@ namespace Network
 
     bool TCPClient::connect(const std::string & name, int port)
     {
-        IPaddress ip;
+        struct addrinfo hints;
+        std::memset(& hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
 
-        if(0 > SDLNet_ResolveHost(&ip, name.size() ? name.c_str() : nullptr, port))
+        struct addrinfo* res = nullptr;
+        auto service = std::to_string(port);
+
+        if(int err = getaddrinfo(name.size() ? name.c_str() : nullptr, service.c_str(), & hints, & res))
         {
-            ERROR(SDLNet_GetError());
+            ERROR("getaddrinfo failed, host: " << name << ", error: " << gai_strerror(err));
             return false;
         }
 
-        return TCPStream::open(SDLNet_TCP_Open(&ip));
+        int fd = -1;
+
+        for(auto ai = res; ai && 0 > fd; ai = ai->ai_next)
+        {
+            fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+            if(0 > fd)
+                continue;
+
+            if(0 > ::connect(fd, ai->ai_addr, ai->ai_addrlen) && errno != EINPROGRESS)
+            {
+                ::close(fd);
+                fd = -1;
+                continue;
+            }
+
+            // wait connected
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            int err = 0;
+            socklen_t errlen = sizeof(err);
+
+            if(0 >= poll(& pfd, 1, timeout) ||
+                0 > getsockopt(fd, SOL_SOCKET, SO_ERROR, & err, & errlen) || err)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+        freeaddrinfo(res);
+
+        if(0 > fd)
+        {
+            ERROR("connect failed, host: " << name << ", port: " << port);
+            return false;
+        }
+
+        return TCPStream::open(fd);
     }
 
     /* TCPClientDebug */
@@ -378,7 +917,8 @@ namespace Network
     {
         if(ofs.is_open())
         {
-            std::string str = SWE::Tools::buffer2HexString<uint8_t>(buf.data(), buf.size(), 2, ",", false);
+            auto data = buf.toVector();
+            std::string str = SWE::Tools::buffer2HexString<uint8_t>(data.data(), data.size(), 2, ",", false);
             ofs << "> " << str << std::endl;
         }
 
@@ -413,48 +953,34 @@ namespace Network
         buf.reserve(4 * 1024);
     }
 
-    std::vector<uint8_t> ZlibContext::deflateFlush(bool finish)
-    {
-        next_in = buf.data();
-        avail_in = buf.size();
-        std::vector<uint8_t> zip(deflateBound(this, buf.size()));
-        next_out = zip.data();
-        avail_out = zip.size();
-        int prev = total_out;
-        int ret = deflate(this, finish ? Z_FINISH : Z_SYNC_FLUSH);
-
-        if(ret < Z_OK)
-            throw std::runtime_error(std::string("ZlibContext::deflateFlush: failed code: ").append(std::to_string(ret)));
-
-        size_t zipsz = total_out - prev;
-        zip.resize(zipsz);
-        buf.clear();
-        next_in = nullptr;
-        avail_in = 0;
-        next_out = nullptr;
-        avail_out = 0;
-
-        return zip;
-    }
-
     void ZlibContext::inflateFlush(const std::vector<uint8_t> & zip)
     {
-        std::array<uint8_t, 1024> tmp;
-        next_in = (Bytef*) zip.data();
+        const size_t chunk = std::max(zip.size() * 4, size_t(32 * 1024));
+        next_in = (decltype(next_in)) zip.data();
         avail_in = zip.size();
 
-        do
+        // inflate straight to the buffer tail, until the output is not full
+        while(true)
         {
-            next_out = tmp.data();
-            avail_out = tmp.size();
+            auto pos = buf.size();
+            buf.resize(pos + chunk);
+
+            next_out = buf.data() + pos;
+            avail_out = chunk;
             int ret = inflate(this, Z_NO_FLUSH);
 
+            buf.resize(buf.size() - avail_out);
+
+            // no progress possible: input used, output flushed
+            if(ret == Z_BUF_ERROR)
+                break;
+
             if(ret < Z_OK)
                 throw std::runtime_error(std::string("ZlibContext::inflateFlush: failed code: ").append(std::to_string(ret)));
 
-            buf.insert(buf.end(), tmp.begin(), std::next(tmp.begin(), (tmp.size() - avail_out)));
+            if(avail_in == 0 && avail_out != 0)
+                break;
         }
-        while(avail_in > 0);
 
         next_in = nullptr;
         avail_in = 0;
@@ -463,10 +989,10 @@ namespace Network
     }
 
     /* DeflateStream */
-    DeflateStream::DeflateStream(int level)
+    DeflateStream::DeflateStream(int lvl) : chain(nullptr), lengthPos(0), lengthSize(0), totalOut(0), level(lvl), nextLevel(lvl), elapsed(0)
     {
         if(level < Z_BEST_SPEED || Z_BEST_COMPRESSION < level)
-            level = Z_BEST_COMPRESSION;
+            level = nextLevel = Z_BEST_COMPRESSION;
 
         auto ptr = new ZlibContext();
         zlib.reset(ptr);
@@ -474,6 +1000,8 @@ namespace Network
 
         if(ret < Z_OK)
             throw std::runtime_error(std::string("DeflateStream: init failed, code: ").append(std::to_string(ret)));
+
+        zlib->buf.reserve(32 * 1024);
     }
 
     DeflateStream::~DeflateStream()
@@ -481,20 +1009,113 @@ namespace Network
         deflateEnd(zlib.get());
     }
 
-    void DeflateStream::prepareSize(size_t len)
+    void DeflateStream::setCompressLevel(int lvl)
+    {
+        // applied with next block
+        if(Z_BEST_SPEED <= lvl && lvl <= Z_BEST_COMPRESSION)
+            nextLevel = lvl;
+    }
+
+    std::chrono::microseconds DeflateStream::takeElapsed(void)
+    {
+        auto res = elapsed;
+        elapsed = std::chrono::microseconds(0);
+        return res;
+    }
+
+    void DeflateStream::deflateStart(BufferChain & out, size_t lensz)
+    {
+        chain = & out;
+        lengthSize = lensz;
+        lengthPos = chain->reserve(lengthSize);
+        totalOut = 0;
+
+        if(nextLevel != level)
+        {
+            // stream flushed between blocks, deflateParams output (if any) goes to this block
+            size_t free = 0;
+            zlib->next_out = chain->tail(free);
+            zlib->avail_out = free;
+
+            int ret = deflateParams(zlib.get(), nextLevel, Z_DEFAULT_STRATEGY);
+
+            size_t used = free - zlib->avail_out;
+            chain->commit(used);
+            totalOut += used;
+
+            zlib->next_out = nullptr;
+            zlib->avail_out = 0;
+
+            if(ret < Z_OK && ret != Z_BUF_ERROR)
+                ERROR("deflateParams failed, code: " << ret);
+
+            level = nextLevel;
+        }
+    }
+
+    size_t DeflateStream::deflateStop(void)
     {
-        if(len < zlib->buf.capacity()) zlib->buf.reserve(len);
+        if(! chain)
+            throw std::runtime_error("DeflateStream::deflateStop: not started");
+
+        deflateChunk(Z_SYNC_FLUSH);
+
+        // compressed length: big endian
+        uint8_t len[4] = { 0 };
+
+        for(size_t it = 0; it < lengthSize; ++it)
+            len[it] = totalOut >> (8 * (lengthSize - it - 1));
+
+        chain->patch(lengthPos, len, lengthSize);
+        chain = nullptr;
+
+        return lengthSize + totalOut;
     }
 
-    std::vector<uint8_t> DeflateStream::deflateFlush(void) const
+    void DeflateStream::deflateChunk(int flush)
     {
-        return zlib->deflateFlush();
+        auto start = std::chrono::steady_clock::now();
+
+        zlib->next_in = zlib->buf.data();
+        zlib->avail_in = zlib->buf.size();
+
+        do
+        {
+            size_t free = 0;
+            zlib->next_out = chain->tail(free);
+            zlib->avail_out = free;
+
+            int ret = deflate(zlib.get(), flush);
+
+            if(ret < Z_OK && ret != Z_BUF_ERROR)
+                throw std::runtime_error(std::string("DeflateStream::deflateChunk: failed code: ").append(std::to_string(ret)));
+
+            size_t used = free - zlib->avail_out;
+            chain->commit(used);
+            totalOut += used;
+        }
+        while(0 == zlib->avail_out);
+
+        zlib->buf.clear();
+        zlib->next_in = nullptr;
+        zlib->avail_in = 0;
+        zlib->next_out = nullptr;
+        zlib->avail_out = 0;
+
+        elapsed += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
     }
 
     void DeflateStream::sendRaw(const void* ptr, size_t len)
     {
+        if(! chain)
+            throw std::runtime_error("DeflateStream::sendRaw: not started");
+
         auto buf2 = reinterpret_cast<const uint8_t*>(ptr);
         zlib->buf.insert(zlib->buf.end(), buf2, buf2 + len);
+
+        // compress by chunks, input buffer bounded
+        if(32 * 1024 <= zlib->buf.size())
+            deflateChunk(Z_NO_FLUSH);
     }
 
     void DeflateStream::recvRaw(void* ptr, size_t len) const
@@ -512,7 +1133,6 @@ namespace Network
     {
         auto ptr = new ZlibContext();
         zlib.reset(ptr);
-        it = zlib->buf.begin();
 
         int ret = inflateInit2(ptr, MAX_WBITS);
         if(ret < Z_OK)
@@ -526,34 +1146,53 @@ namespace Network
 
     void InflateStream::appendData(const std::vector<uint8_t> & zip)
     {
-        if(it != zlib->buf.end())
-            zlib->buf.erase(it, zlib->buf.end());
+        // keep unread data
+        if(recvHead < recvTail)
+            zlib->buf.erase(zlib->buf.begin(), std::next(zlib->buf.begin(), recvHead - zlib->buf.data()));
         else
             zlib->buf.clear();
 
         zlib->inflateFlush(zip);
-        // fixed pos
-        it = zlib->buf.begin();
+
+        recvHead = zlib->buf.data();
+        recvTail = recvHead + zlib->buf.size();
     }
 
-    void InflateStream::recvRaw(void* ptr, size_t len) const
+    const uint8_t* InflateStream::recvPtr(size_t len) const
     {
-        size_t total = std::distance(it, zlib->buf.end());
+        if(recvBuffered() < len)
+            throw std::runtime_error(SWE::StringFormat("InflateStream::recvPtr: read bytes: %1, expected: %2, buf: %3").arg(recvBuffered()).arg(len).arg(zlib->buf.size()));
 
-        if(total < len)
-            throw std::runtime_error(SWE::StringFormat("InflateStream::recvRaw: read bytes: %1, expected: %2, buf: %3").arg(total).arg(len).arg(zlib->buf.size()));
+        auto res = recvHead;
+        recvHead += len;
+
+        return res;
+    }
 
-        auto buf2 = reinterpret_cast<uint8_t*>(ptr);
-        while(len--) *buf2++ = *it++;
+    void InflateStream::recvRaw(void* ptr, size_t len) const
+    {
+        std::memcpy(ptr, recvPtr(len), len);
     }
 
     bool InflateStream::hasInput(void) const
     {
-        return it != zlib->buf.end();
+        return recvHead < recvTail;
     }
 
     void InflateStream::sendRaw(const void* ptr, size_t len)
     {
         throw std::runtime_error("InflateStream::sendRaw: disabled");
     }
+
+    /* MemoryStream */
+    void MemoryStream::recvRaw(void* buf, size_t len) const
+    {
+        if(! recvWindow(buf, len))
+            throw std::runtime_error(SWE::StringFormat("MemoryStream::recvRaw: read bytes: %1, expected: %2").arg(recvBuffered()).arg(len));
+    }
+
+    void MemoryStream::sendRaw(const void* ptr, size_t len)
+    {
+        throw std::runtime_error("MemoryStream::sendRaw: disabled");
+    }
 }
@@ -23,14 +23,31 @@
 #ifndef _STORAGE_NETWORK_
 #define _STORAGE_NETWORK_
 
+#include <list>
 #include <vector>
 #include <string>
 #include <memory>
+#include <cstring>
 #include <fstream>
 
+#ifdef WITH_ZLIB_NG
+#include <zlib-ng.h>
+// zlib-ng native api
+#define z_stream        zng_stream
+#define deflateInit2    zng_deflateInit2
+#define deflateParams   zng_deflateParams
+#define deflateEnd      zng_deflateEnd
+#define deflate         zng_deflate
+#define inflateInit2    zng_inflateInit2
+#define inflateEnd      zng_inflateEnd
+#define inflate         zng_inflate
+#else
 #include <zlib.h>
+#endif
+#include <chrono>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 
-#include "SDL_net.h"
 #include "libswe.h"
 
 namespace Network
@@ -38,8 +55,24 @@ namespace Network
     /// @brief: network stream interface
     class BaseStream
     {
+    protected:
+        /// buffered input window: fields parsed from it without virtual calls, recvRaw consume it first
+        mutable const uint8_t* recvHead;
+        mutable const uint8_t* recvTail;
+
+        size_t           recvBuffered(void) const { return recvTail - recvHead; }
+        bool             recvWindow(void* ptr, size_t len) const
+        {
+            if(recvBuffered() < len)
+                return false;
+
+            std::memcpy(ptr, recvHead, len);
+            recvHead += len;
+            return true;
+        }
+
     public:
-        BaseStream() {}
+        BaseStream() : recvHead(nullptr), recvTail(nullptr) {}
         virtual ~BaseStream() {}
 
         BaseStream &     sendIntBE16(uint16_t v);
@@ -84,20 +117,125 @@ namespace Network
         std::string          recvString(size_t) const;
     };
 
+    /// @brief: chunked output buffer, released blocks returned to pool
+    class BufferChain
+    {
+        struct Block
+        {
+            std::vector<uint8_t> data;
+            size_t      begin;
+            size_t      end;
+
+            Block(size_t sz) : data(sz), begin(0), end(0) {}
+
+            size_t      free(void) const { return data.size() - end; }
+            size_t      size(void) const { return end - begin; }
+        };
+
+        std::list<Block> blocks;
+        std::list<Block> pool;
+        size_t      blockSize;
+        size_t      poolLimit;
+        size_t      length;
+        size_t      released;
+        size_t      pinned;
+
+        void        appendBlock(void);
+        void        appendSlow(const uint8_t*, size_t);
+
+    public:
+        BufferChain(size_t blocksz = 64 * 1024, size_t poollim = 16);
+
+        void        append(const void* ptr, size_t len)
+        {
+            if(! blocks.empty() && len <= blocks.back().free())
+            {
+                auto & block = blocks.back();
+                std::memcpy(block.data.data() + block.end, ptr, len);
+                block.end += len;
+                length += len;
+            }
+            else
+                appendSlow(static_cast<const uint8_t*>(ptr), len);
+        }
+
+        void        appendZero(size_t);
+        void        consume(size_t);
+        void        clear(void);
+
+        size_t      size(void) const { return length; }
+        bool        empty(void) const { return 0 == length; }
+        size_t      fullBlocksSize(void) const;
+
+        // direct write to tail
+        uint8_t*    tail(size_t & free);
+        void        commit(size_t len);
+
+        // placeholder: blocks from position are not sent until patched
+        size_t      reserve(size_t len);
+        void        patch(size_t pos, const void*, size_t len);
+
+        void        iovecs(std::vector<struct iovec> &, bool fullBlocksOnly) const;
+        std::vector<uint8_t> toVector(void) const;
+    };
+
+    /// @brief: epoll event loop with wakeup support
+    class EventLoop
+    {
+        int         epfd;
+        int         evfd;
+
+    public:
+        EventLoop();
+        ~EventLoop();
+
+        bool        add(int fd, uint32_t events, void* ptr = nullptr);
+        bool        modify(int fd, uint32_t events, void* ptr = nullptr);
+        bool        remove(int fd);
+
+        int         wait(std::vector<struct epoll_event> &, int ms);
+        void        wakeup(void);
+    };
+
+    /// @brief: nonblocking tcp socket stream
     class TCPStream : public BaseStream
     {
     protected:
-        TCPsocket            sock;
-        SDLNet_SocketSet     sdset;
-        std::vector<uint8_t> buf;
+        int                  sock;
+        int                  timeout;
+        size_t               highWater;
+        BufferChain          buf;
+        std::vector<struct iovec> iov;
+        std::chrono::microseconds waitOutput;
+        mutable std::vector<uint8_t> recvBuf;
+
+        bool        waitEvent(short events, int ms) const;
+        size_t      recvSocket(uint8_t*, size_t need, size_t capacity) const;
+        void        sendVector(struct iovec*, int counts);
+        void        sendBlocks(bool fullBlocksOnly);
 
     public:
-        TCPStream(TCPsocket val = nullptr);
+        TCPStream(int fd = -1);
         ~TCPStream();
 
-        bool        open(TCPsocket val);
+        bool        open(int fd);
         void        close(void);
+        void        shutdown(void);
+
+        int         descriptor(void) const { return sock; }
+        std::string peerAddress(void) const;
+
+        void        setTimeout(int ms) { timeout = ms; }
+        void        setHighWater(size_t sz) { highWater = sz; }
+        void        setNoDelay(bool);
+        void        setCork(bool);
+        void        setRecvBuffer(size_t);
 
+        BufferChain & sendBuffer(void) { return buf; }
+        void        sendOverflow(void);
+        std::chrono::microseconds takeWaitOutput(void);
+
+        bool        waitInput(int ms) const;
         bool        hasInput(void) const override;
         void        sendRaw(const void*, size_t) override;
         void        recvRaw(void*, size_t) const override;
@@ -109,7 +247,7 @@ namespace Network
     public:
         TCPServer() {}
 
-        TCPsocket   accept(void);
+        int         accept(void);
         bool        listen(int port);
     };
 
@@ -140,24 +278,36 @@ namespace Network
 
         ZlibContext();
     
-        std::vector<uint8_t> deflateFlush(bool finish = false);
         void inflateFlush(const std::vector<uint8_t> &);
     };
 
-    /// @brief: zlib compress output stream only (VNC version)
+    /// @brief: zlib compress output stream only (VNC version), persistent stream written to BufferChain
     class DeflateStream : public BaseStream
     {
     protected:
         std::unique_ptr<ZlibContext> zlib;
+        BufferChain*    chain;
+        size_t          lengthPos;
+        size_t          lengthSize;
+        size_t          totalOut;
+        int             level;
+        int             nextLevel;
+        std::chrono::microseconds elapsed;
+
+        void            deflateChunk(int flush);
 
     public:
         DeflateStream(int level = Z_BEST_COMPRESSION);
         ~DeflateStream();
 
-        std::vector<uint8_t> deflateFlush(void) const;
-        void        prepareSize(size_t);
+        int             compressLevel(void) const { return nextLevel; }
+        void            setCompressLevel(int);
+        std::chrono::microseconds takeElapsed(void);
 
-        void        sendRaw(const void*, size_t) override;
+        void            deflateStart(BufferChain &, size_t lengthSize);
+        size_t          deflateStop(void);
+
+        void            sendRaw(const void*, size_t) override;
 
     private:
         bool        hasInput(void) const override;
@@ -169,13 +319,13 @@ namespace Network
     {
     protected:
         std::unique_ptr<ZlibContext> zlib;
-        mutable std::vector<uint8_t>::iterator it;
 
     public:
         InflateStream();
         ~InflateStream();
 
         void        appendData(const std::vector<uint8_t> &);
+        const uint8_t* recvPtr(size_t) const;
 
         bool        hasInput(void) const override;
         void        recvRaw(void*, size_t) const override;
@@ -183,6 +333,19 @@ namespace Network
     private:
         void        sendRaw(const void*, size_t) override;
     };
+
+    /// @brief: read only view over memory block, used for parallel decoding
+    class MemoryStream : public BaseStream
+    {
+    public:
+        MemoryStream(const uint8_t* buf, size_t len) { recvHead = buf; recvTail = buf + len; }
+
+        bool        hasInput(void) const override { return recvHead < recvTail; }
+        void        recvRaw(void*, size_t) const override;
+
+    private:
+        void        sendRaw(const void*, size_t) override;
+    };
 }
 
 #endif
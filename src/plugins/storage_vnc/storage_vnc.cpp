@@ -24,6 +24,8 @@
 #include <atomic>
 #include <thread>
 #include <memory>
+#include <mutex>
+#include <list>
 
 using namespace std::chrono_literals;
 
@@ -36,16 +38,38 @@ extern "C" {
 
 const int storage_vnc_version = 20220415;
 
+struct storage_vnc_client_t
+{
+    std::unique_ptr<RFB::ServerConnector> vnc;
+    std::thread         thread;
+    std::atomic<bool>   finished;
+
+    storage_vnc_client_t(int sock, const SWE::JsonObject* config, RFB::SurfaceScaler* scaler) : vnc(new RFB::ServerConnector(sock, config, scaler)), finished(false)
+    {
+    }
+
+    ~storage_vnc_client_t()
+    {
+        vnc->shutdown();
+        if(thread.joinable())
+            thread.join();
+    }
+};
+
 struct storage_vnc_t
 {
     int        debug;
     Network::TCPServer sn;
+    Network::EventLoop loop;
     int         port;
     std::thread	threadVncCommunication;
     std::atomic<bool> vncThreadShutdown;
-    bool frameBufferReceived;
+    std::atomic<bool> frameBufferReceived;
     const SWE::JsonObject* config;
-    std::unique_ptr<RFB::ServerConnector> vnc;
+    std::mutex  clientsLock;
+    std::list< std::unique_ptr<storage_vnc_client_t> > clients;
+    Surface     lastSurface;
+    RFB::SurfaceScaler scaler;
 
     storage_vnc_t() : debug(0), port(0), vncThreadShutdown(false), frameBufferReceived(false), config(nullptr)
     {
@@ -56,61 +80,79 @@ struct storage_vnc_t
         clear();
     }
 
-    static void start_thread(storage_vnc_t* st)
+    static void client_thread(storage_vnc_t* st, storage_vnc_client_t* client)
     {
-        // wait accept
-        TCPsocket sock = nullptr;
-        DEBUG("start thread");
+        std::string peer = client->vnc->peerAddress();
+        VERBOSE("client: connected, addr: " << peer);
 
-        while(! st->vncThreadShutdown)
+        // wait set surface
+        while(! st->frameBufferReceived && ! st->vncThreadShutdown)
+            std::this_thread::sleep_for(100ms);
+
+        if(! st->vncThreadShutdown)
         {
-            // wait accept
-            while(! st->vncThreadShutdown)
+            try
             {
-                sock = st->sn.accept();
-                if(sock) break;
-                std::this_thread::sleep_for(50ms);
+                client->vnc->communication(peer);
             }
-
-            if(! sock)
+            catch(const std::exception & err)
             {
-                ERROR("socket is null");
-                std::this_thread::sleep_for(50ms);
-                continue;
+                ERROR("exception: " << err.what());
             }
+            catch(...)
+            {
+                ERROR("exception: " << "unknown");
+            }
+        }
+
+        VERBOSE("client: disconnected, addr: " << peer);
+        client->finished = true;
+        st->loop.wakeup();
+    }
 
-            VERBOSE("client: connected");
-            st->vnc.reset(new RFB::ServerConnector(sock, st->config));
+    static void start_thread(storage_vnc_t* st)
+    {
+        std::vector<struct epoll_event> events;
+        DEBUG("start thread");
 
-            // wait set surface
-            while(! st->frameBufferReceived)
-                std::this_thread::sleep_for(100ms);
+        if(! st->loop.add(st->sn.descriptor(), EPOLLIN))
+            return;
+
+        while(! st->vncThreadShutdown)
+        {
+            // wait accept or client finished
+            int counts = st->loop.wait(events, 1000);
 
-            if(! st->vncThreadShutdown)
+            const std::lock_guard<std::mutex> lock(st->clientsLock);
+
+            // remove disconnected
+            st->clients.remove_if([](auto & client){ return client->finished.load(); });
+
+            if(0 < counts && ! st->vncThreadShutdown)
             {
-                IPaddress* ipa = sock ? SDLNet_TCP_GetPeerAddress(sock) : nullptr;
-                std::string peer = StringFormat("%4.%3.%2.%1").
-                               arg(ipa ? 0xFF & (ipa->host >> 24) : 0).arg(ipa ? 0xFF & (ipa->host >> 16) : 0).
-                               arg(ipa ? 0xFF & (ipa->host >> 8) : 0).arg(ipa ? 0xFF & ipa->host : 0);
+                int sock = -1;
 
-                try
+                while(0 <= (sock = st->sn.accept()))
                 {
-                    st->vnc->communication(peer);
-                }
-                catch(const std::exception & err)
-                {
-                    ERROR("exception: " << err.what());
-                }
-                catch(...)
-                {
-                    ERROR("exception: " << "unknown");
+                    try
+                    {
+                        auto client = std::make_unique<storage_vnc_client_t>(sock, st->config, & st->scaler);
+
+                        if(st->lastSurface.isValid())
+                            client->vnc->setFrameBuffer(st->lastSurface);
+
+                        client->thread = std::thread(client_thread, st, client.get());
+                        st->clients.emplace_back(std::move(client));
+                    }
+                    catch(const std::exception & err)
+                    {
+                        ERROR("exception: " << err.what());
+                    }
                 }
 
-                st->vnc.reset();
-                st->frameBufferReceived = false;
+                if(st->debug)
+                    DEBUG("clients: " << st->clients.size());
             }
-
-            VERBOSE("client: disconnected");
         }
     }
 
@@ -132,15 +174,32 @@ struct storage_vnc_t
     void clear(void)
     {
         vncThreadShutdown = true;
+        loop.wakeup();
+
         if(threadVncCommunication.joinable())
             threadVncCommunication.join();
 
+        clients.clear();
+        lastSurface.reset();
+
         debug = 0;
         sn.close();
         config = nullptr;
         vncThreadShutdown = false;
         frameBufferReceived = false;
     }
+
+    bool setFrameBuffer(const Surface & surf)
+    {
+        const std::lock_guard<std::mutex> lock(clientsLock);
+        lastSurface = surf;
+
+        for(auto & client : clients)
+            client->vnc->setFrameBuffer(surf);
+
+        frameBufferReceived = true;
+        return ! clients.empty();
+    }
 };
 
 void* storage_vnc_init(const JsonObject & config)
@@ -173,9 +232,6 @@ void storage_vnc_quit(void* ptr)
 
     if(st->debug) DEBUG("version: " << storage_vnc_version);
 
-    st->vncThreadShutdown = true;
-    if(st->vnc) st->vnc->shutdown();
-
     delete st;
 }
 
@@ -278,12 +334,7 @@ bool storage_vnc_set_value(void* ptr, int type, const void* val)
 		if(! res->isValid())
 		    return false;
 
-                if(st->vnc)
-		{
-                    st->vnc->setFrameBuffer(*res);
-            	    st->frameBufferReceived = true;
-            	    return true;
-		}
+                return st->setFrameBuffer(*res);
             }
             break;
 
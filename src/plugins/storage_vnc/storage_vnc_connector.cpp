@@ -34,20 +34,65 @@ using namespace std::chrono_literals;
 namespace RFB
 {
     /* Connector */
-    ServerConnector::ServerConnector(TCPsocket sock, const SWE::JsonObject* jo)
-        : streamIn(nullptr), streamOut(nullptr), debug(0), encodingDebug(0), encodingThreads(2),
-            loopMessage(true), fbUpdateProcessing(false), clientUpdateReq(false), fbPtr(nullptr), config(jo)
+    SWE::Surface SurfaceScaler::get(const SWE::Surface & surf, const Size & sz)
+    {
+        if(sz.isEmpty() || (sz.w == surf.width() && sz.h == surf.height()))
+            return surf;
+
+        const std::lock_guard<std::mutex> guard(lock);
+
+        // new frame: previous scales not needed
+        if(source != surf)
+        {
+            source = surf;
+            scaled.clear();
+        }
+
+        auto & res = scaled[std::make_pair(sz.w, sz.h)];
+
+        if(! res.isValid())
+            res = SWE::Surface::scale(surf, SWE::Size(sz.w, sz.h), true);
+
+        return res;
+    }
+
+    ServerConnector::ServerConnector(int sock, const SWE::JsonObject* jo, SurfaceScaler* sc)
+        : zlib(nullptr), streamIn(nullptr), streamOut(nullptr), debug(0), encodingDebug(0), encodingThreads(2),
+            zlibLevelMax(6), zlibLevel(6), zlibBudget(20), zlibAdaptive(true), adaptiveMode(false), linkBandwidth(12.5),
+            sendBytes(0), adaptiveTiles(0), loopMessage(true), fbUpdateProcessing(false), clientUpdateReq(false), frameUpdated(false), frameSkipped(0), updateInterval(0),
+            scaler(sc), clientResize(true), desktopAnnounced(false), desktopReason(-1), desktopStatus(0), fbPtr(nullptr), config(jo)
     {
         debug = config->getInteger("debug", 0);
         socket.reset(new Network::TCPStream(sock));
+        socket->setHighWater(config->getInteger("highwater", 1024 * 1024));
+        zlibLevelMax = std::max(Z_BEST_SPEED, std::min(config->getInteger("zlib:level", 6), Z_BEST_COMPRESSION));
+        zlibAdaptive = config->getBoolean("zlib:adaptive", true);
+        zlibBudget = config->getInteger("zlib:budget", 20);
+        zlibLevel = zlibLevelMax;
+        adaptiveMode = config->getBoolean("adaptive", false);
+        // initial link estimate: Mbit/s to bytes per usec
+        linkBandwidth = std::max(1, config->getInteger("adaptive:bandwidth", 100)) / 8.0;
+
+        auto scale = SWE::JsonUnpack::size(*config, "scale");
+        outputSize = Size(std::max(0, scale.w), std::max(0, scale.h));
+        clientResize = config->getBoolean("scale:client", true);
+
+        int fps = config->getInteger("fps", 0);
+        if(0 < fps)
+            updateInterval = std::chrono::microseconds(1000000 / fps);
         streamIn = streamOut = socket.get();
+
+        if(! loop.add(socket->descriptor(), EPOLLIN))
+            throw std::runtime_error("ServerConnector: event loop add failed");
     }
 
     ServerConnector::~ServerConnector()
     {
         loopMessage = false;
 
-        waitSendingFBUpdate();
+        // update thread uses loop and flags after the processing flag dropped
+        if(fbUpdateThread.joinable())
+            fbUpdateThread.join();
     }
 
     void ServerConnector::sendFlush(void)
@@ -59,7 +104,13 @@ namespace RFB
     void ServerConnector::sendRaw(const void* ptr, size_t len)
     {
         if(loopMessage)
+        {
             streamOut->sendRaw(ptr, len);
+
+            // zlib output counted on stop
+            if(streamOut == socket.get())
+                sendBytes += len;
+        }
     }
 
     void ServerConnector::recvRaw(void* ptr, size_t len) const
@@ -73,6 +124,11 @@ namespace RFB
         return loopMessage ? streamIn->hasInput() : false;
     }
 
+    std::string ServerConnector::peerAddress(void) const
+    {
+        return socket->peerAddress();
+    }
+
     bool ServerConnector::clientAuthVnc(bool debug)
     {
         std::vector<uint8_t> challenge = TLS::randomKey(16);
@@ -136,6 +192,15 @@ namespace RFB
     int ServerConnector::communication(const std::string & remoteaddr)
     {
         DEBUG("remote addr: " << remoteaddr);
+
+        frameBufferApply();
+
+        if(! fbPtr)
+        {
+            ERROR("frame buffer not ready");
+            return EXIT_FAILURE;
+        }
+
         encodingThreads = config->getInteger("threads", 2);
 
         if(encodingThreads < 1)
@@ -233,6 +298,7 @@ namespace RFB
         sendInt8(serverFormat.blueShift);
         // default client format
         clientFormat = serverFormat;
+        updatePixelConverter();
         clientRegion = fbPtr->region();
         // send padding
         sendInt8(0);
@@ -248,7 +314,7 @@ namespace RFB
         while(loopMessage)
         {
             // RFB: mesage loop
-            if(hasInput())
+            while(hasInput())
             {
                 int msgType = recvInt8();
 
@@ -287,18 +353,47 @@ namespace RFB
                         clientUpdateReq = true;
                         break;
 
+                    case RFB::CLIENT_SET_DESKTOP_SIZE:
+                        clientSetDesktopSize();
+                        clientUpdateReq = true;
+                        break;
+
                     default:
                         throw std::runtime_error(std::string("RFB unknown message: ").append(SWE::String::hex(msgType, 2)));
                 }
             }
 
+            int timeout = 1000;
+
             // server action
+            if(! isUpdateProcessed())
+            {
+                auto now = std::chrono::steady_clock::now();
+
+                // fps limit: pending frame stays in mailbox, replaced by newer
+                if(now < updateNext)
+                {
+                    if(clientUpdateReq || frameUpdated)
+                        timeout = std::chrono::duration_cast<std::chrono::milliseconds>(updateNext - now).count() + 1;
+                }
+                else
+                if(frameBufferApply() || clientUpdateReq)
+                {
+                    clientUpdateReq = true;
+                    updateNext = now + updateInterval;
+                }
+            }
+
             if(! isUpdateProcessed() && clientUpdateReq)
             {
                 fbUpdateProcessing = true;
 
+                // previous job complete, only the thread tail remains
+                if(fbUpdateThread.joinable())
+                    fbUpdateThread.join();
+
                 // background job
-                std::thread([this, res = clientRegion]()
+                fbUpdateThread = std::thread([this, res = clientRegion]()
                 {
                     bool error = false;
                     try
@@ -321,12 +416,14 @@ namespace RFB
                     if(error)
                         this->loopMessage = false;
 
-                }).detach();
+                    this->loop.wakeup();
+                });
                 clientUpdateReq = false;
             }
 
-            // wait
-            std::this_thread::sleep_for(5ms);
+            // wait: client input, update complete or new frame buffer
+            if(loopMessage)
+                loop.wait(events, timeout);
         }
 
         return EXIT_SUCCESS;
@@ -335,6 +432,8 @@ namespace RFB
     void ServerConnector::shutdown(void)
     {
         loopMessage = false;
+        socket->shutdown();
+        loop.wakeup();
     }
 
     bool ServerConnector::isUpdateProcessed(void) const
@@ -391,7 +490,10 @@ namespace RFB
         if(trueColor == 0 || redMax == 0 || greenMax == 0 || blueMax == 0)
             throw std::runtime_error("unsupported pixel format");
 
+        const std::lock_guard<std::mutex> lock(sendGlobal);
         clientFormat = PixelFormat(bitsPerPixel, depth, bigEndian, trueColor, redMax, greenMax, blueMax, redShift, greenShift, blueShift);
+        updatePixelConverter();
+        adaptiveReset();
     }
 
     bool ServerConnector::clientSetEncodings(void)
@@ -403,13 +505,13 @@ namespace RFB
         int numEncodings = recvIntBE16();
         if(debug)
             DEBUG("RFB 6.4.2, set encodings, counts: " << numEncodings);
-        clientEncodings.clear();
-        clientEncodings.reserve(numEncodings);
+        std::vector<int> encodings;
+        encodings.reserve(numEncodings);
 
         while(0 < numEncodings--)
         {
             int encoding = recvIntBE32();
-            clientEncodings.push_back(encoding);
+            encodings.push_back(encoding);
 
             if(1 < debug)
             {
@@ -417,11 +519,32 @@ namespace RFB
             }
         }
 
+        // wait update complete
+        const std::lock_guard<std::mutex> lock(sendGlobal);
+        clientEncodings.swap(encodings);
         prefEncodings = selectEncodings();
-        DEBUG("server select encoding: " << RFB::encodingName(prefEncodings.second));
+        DEBUG("server select encoding: " << RFB::encodingName(prefEncodings.second) << (adaptiveEncodings.empty() ? "" : ", adaptive"));
+
+        zlibLevel = zlibTargetLevel();
+        for(auto & pair : zlibStreams)
+            pair.second->setCompressLevel(zlibLevel);
 
-        if(std::any_of(clientEncodings.begin(), clientEncodings.end(),
-                    [=](auto & val){ return val == RFB::ENCODING_CONTINUOUS_UPDATES; }))
+        bool announce = false;
+
+        // RFB: the server confirms ExtendedDesktopSize support with the first update
+        if(! desktopAnnounced && clientSupported(RFB::ENCODING_EXT_DESKTOP_SIZE))
+        {
+            desktopAnnounced = true;
+            announce = true;
+
+            if(desktopReason < 0)
+            {
+                desktopReason = 0;
+                desktopStatus = 0;
+            }
+        }
+
+        if(clientSupported(RFB::ENCODING_CONTINUOUS_UPDATES))
         {
             // RFB 1.7.7.15
             // The server must send a EndOfContinuousUpdates message the first time
@@ -433,7 +556,58 @@ namespace RFB
             // serverSendEndContinuousUpdates();
         }
 
-        return previousType != prefEncodings.second;
+        return announce || previousType != prefEncodings.second;
+    }
+
+    bool ServerConnector::clientSupported(int encoding) const
+    {
+        return std::any_of(clientEncodings.begin(), clientEncodings.end(),
+                    [=](auto & val){ return val == encoding; });
+    }
+
+    void ServerConnector::clientSetDesktopSize(void)
+    {
+        // RFB: 1.7.4.10
+        // skip padding
+        recvSkip(1);
+        int width = recvIntBE16();
+        int height = recvIntBE16();
+        int screens = recvInt8();
+        // skip padding
+        recvSkip(1);
+        // screen id, x, y, w, h, flags: single screen only, layout ignored
+        recvSkip(screens * 16);
+
+        if(debug)
+            DEBUG("RFB 1.7.4.10, set desktop size: [" << width << ", " << height << "], screens: " << screens);
+
+        const std::lock_guard<std::mutex> lock(sendGlobal);
+        desktopReason = 1;
+
+        if(! clientResize)
+        {
+            // prohibited
+            desktopStatus = 1;
+        }
+        else
+        if(width == 0 || height == 0 || screens == 0)
+        {
+            // invalid screen layout
+            desktopStatus = 3;
+        }
+        else
+        {
+            desktopStatus = 0;
+            outputSize = Size(width, height);
+
+            // rescale the current frame
+            const std::lock_guard<std::mutex> lock2(frameLock);
+            if(! frameUpdated && frameSource.isValid())
+            {
+                framePending = frameSource;
+                frameUpdated = true;
+            }
+        }
     }
 
     void ServerConnector::clientEnableContinuousUpdates(void)
@@ -536,6 +710,15 @@ namespace RFB
         if(debug)
             DEBUG("server send fb update");
 
+        auto start = std::chrono::steady_clock::now();
+        size_t bytes = sendBytes;
+
+        // coalesce header and rectangles to full segments
+        socket->setCork(true);
+
+        if(0 <= desktopReason)
+            serverSendDesktopSize();
+
         // RFB: 6.5.1
         sendInt8(RFB::SERVER_FB_UPDATE);
         // padding
@@ -545,58 +728,104 @@ namespace RFB
         prefEncodings.first(*fbPtr);
 
         sendFlush();
+        socket->setCork(false);
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        auto net = socket->takeWaitOutput();
+
+        updateBandwidth(sendBytes - bytes, elapsed, net);
+        zlibAdaptLevel(net);
         return true;
     }
 
-    int ServerConnector::sendPixel(uint32_t pixel)
+    void ServerConnector::serverSendDesktopSize(void)
     {
-        if(clientFormat.trueColor())
-        {
-            switch(clientFormat.bytePerPixel())
-            {
-                case 4:
-                    if(clientFormat.bigEndian())
-                        sendIntBE32(clientFormat.convertFrom(fbPtr->pixelFormat(), pixel));
-                    else
-                        sendIntLE32(clientFormat.convertFrom(fbPtr->pixelFormat(), pixel));
+        const bool ext = clientSupported(RFB::ENCODING_EXT_DESKTOP_SIZE);
 
-                    return 4;
+        // DesktopSize: server changes only
+        if(! ext && (desktopReason != 0 || ! clientSupported(RFB::ENCODING_DESKTOP_SIZE)))
+        {
+            if(desktopReason == 0)
+                ERROR("client not support desktop resize");
 
-                case 2:
-                    if(clientFormat.bigEndian())
-                        sendIntBE16(clientFormat.convertFrom(fbPtr->pixelFormat(), pixel));
-                    else
-                        sendIntLE16(clientFormat.convertFrom(fbPtr->pixelFormat(), pixel));
+            desktopReason = -1;
+            return;
+        }
 
-                    return 2;
+        if(debug)
+        {
+            DEBUG("server send: desktop size [" << fbPtr->width() << ", " << fbPtr->height() <<
+                    "], reason: " << desktopReason << ", status: " << desktopStatus);
+        }
 
-                case 1:
-                    sendInt8(clientFormat.convertFrom(fbPtr->pixelFormat(), pixel));
-                    return 1;
+        // RFB: 6.5.1, single rect
+        sendInt8(RFB::SERVER_FB_UPDATE);
+        sendInt8(0);
+        sendIntBE16(1);
 
-                default:
-                    break;
-            }
+        if(ext)
+        {
+            // RFB: 1.7.7.11, position fields: reason, status
+            sendHeader(Region(desktopReason, desktopStatus, fbPtr->width(), fbPtr->height()), RFB::ENCODING_EXT_DESKTOP_SIZE);
+            // screens
+            sendInt8(1);
+            sendZero(3);
+            // screen: id, x, y, w, h, flags
+            sendIntBE32(0);
+            sendIntBE16(0);
+            sendIntBE16(0);
+            sendIntBE16(fbPtr->width());
+            sendIntBE16(fbPtr->height());
+            sendIntBE32(0);
         }
+        else
+        {
+            // RFB: 1.7.7.10
+            sendHeader(Region(0, 0, fbPtr->width(), fbPtr->height()), RFB::ENCODING_DESKTOP_SIZE);
+        }
+
+        desktopReason = -1;
+    }
+
+    void ServerConnector::sendHeader(const Region & reg, int type)
+    {
+        // region size and type: single write
+        const uint8_t buf[12] = {
+            uint8_t(reg.x >> 8), uint8_t(reg.x), uint8_t(reg.y >> 8), uint8_t(reg.y),
+            uint8_t(reg.w >> 8), uint8_t(reg.w), uint8_t(reg.h >> 8), uint8_t(reg.h),
+            uint8_t(type >> 24), uint8_t(type >> 16), uint8_t(type >> 8), uint8_t(type) };
 
-        throw std::runtime_error("send pixel: unknown format");
-        return 0;
+        sendRaw(buf, sizeof(buf));
+    }
+
+    void ServerConnector::updatePixelConverter(void)
+    {
+        if(fbPtr)
+            clientConverter = PixelConverter(fbPtr->pixelFormat(), clientFormat);
+    }
+
+    int ServerConnector::sendPixel(uint32_t pixel)
+    {
+        uint8_t buf[4];
+        auto len = clientConverter.writePixel(pixel, buf);
+
+        sendRaw(buf, len);
+        return len;
     }
 
     int ServerConnector::sendCPixel(uint32_t pixel)
     {
         if(clientFormat.trueColor() && clientFormat.bitsPerPixel == 32)
         {
-            auto pixel2 = clientFormat.convertFrom(fbPtr->pixelFormat(), pixel);
+            auto pixel2 = clientConverter.convert(pixel);
             auto red = clientFormat.red(pixel2);
             auto green = clientFormat.green(pixel2);
             auto blue = clientFormat.blue(pixel2);
 #if (__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__)
             std::swap(red, blue);
 #endif
-            sendInt8(red);
-            sendInt8(green);
-            sendInt8(blue);
+            const uint8_t buf[3] = { uint8_t(red), uint8_t(green), uint8_t(blue) };
+            sendRaw(buf, sizeof(buf));
             return 3;
         }
 
@@ -617,61 +846,177 @@ namespace RFB
         return res + 1;
     }
 
-    void ServerConnector::zlibDeflateStart(size_t len)
+    int ServerConnector::zlibTargetLevel(void) const
     {
+        // RFB: compress level pseudo encodings (-256 .. -247)
         auto it = std::find_if(clientEncodings.begin(), clientEncodings.end(),
                     [=](auto & val){ return ENCODING_COMPRESS1 <= val && val <= ENCODING_COMPRESS9; });
-        int level = it != clientEncodings.end() ? ENCODING_COMPRESS9 - *it : 9;
-
-        if(! zlib)
-            zlib.reset(new Network::DeflateStream(level));
+        int level = it != clientEncodings.end() ? *it - ENCODING_COMPRESS1 + 1 : zlibLevelMax;
 
-        zlib->prepareSize(len);
-        streamOut = zlib.get();
+        return std::min(level, zlibLevelMax);
     }
 
-    int ServerConnector::zlibDeflateStop(bool uint16sz)
+    void ServerConnector::zlibAdaptLevel(const std::chrono::microseconds & net)
     {
-        streamOut = socket.get();
-        auto zip = zlib->deflateFlush();
-        int res = 0;
+        if(zlibStreams.empty())
+            return;
+
+        std::chrono::microseconds cpu(0);
+        for(auto & pair : zlibStreams)
+            cpu += pair.second->takeElapsed();
 
-        if(uint16sz)
+        int level = zlibLevel;
+        int target = zlibTargetLevel();
+
+        if(zlibAdaptive)
         {
-            sendIntBE16(zip.size());
-            res = 2;
+            // cpu bound: deflate time over budget and more than network wait
+            if(std::chrono::milliseconds(zlibBudget) < cpu && net < cpu)
+                level--;
+            else
+            // network bound: better compression is free
+            if(cpu < net)
+                level++;
         }
         else
+            level = target;
+
+        level = std::max(Z_BEST_SPEED, std::min(level, target));
+
+        if(level != zlibLevel)
         {
-            sendIntBE32(zip.size());
-            res = 4;
+            if(debug)
+                DEBUG("zlib level: " << level << ", deflate: " << cpu.count() << "us, network wait: " << net.count() << "us");
+
+            zlibLevel = level;
+            for(auto & pair : zlibStreams)
+                pair.second->setCompressLevel(zlibLevel);
         }
-        sendRaw(zip.data(), zip.size());
-        return res + zip.size();
+    }
+
+    void ServerConnector::updateBandwidth(size_t bytes, const std::chrono::microseconds & elapsed, const std::chrono::microseconds & net)
+    {
+        // small updates say nothing about the link
+        if(bytes < 16384 || elapsed.count() <= 0)
+            return;
+
+        double sample = bytes / double(elapsed.count());
+
+        // network bound: update time is transfer time
+        if(elapsed < 2 * net)
+            linkBandwidth = 0.75 * linkBandwidth + 0.25 * sample;
+        else
+        // cpu bound: link is at least as fast
+        if(linkBandwidth < sample)
+            linkBandwidth = sample;
+
+        if(1 < debug)
+            DEBUG("link estimate: " << int(linkBandwidth * 8) << " Mbit/s, update: " << bytes << " bytes, " << elapsed.count() << "us, network wait: " << net.count() << "us");
+    }
+
+    void ServerConnector::zlibDeflateStart(int type, bool uint16sz)
+    {
+        // RFB: the client keeps separate zlib stream for each encoding
+        auto & ptr = zlibStreams[type];
+        if(! ptr)
+            ptr.reset(new Network::DeflateStream(zlibLevel));
+
+        zlib = ptr.get();
+        // compressed data written directly to socket buffer
+        zlib->deflateStart(socket->sendBuffer(), uint16sz ? 2 : 4);
+        streamOut = zlib;
+    }
+
+    int ServerConnector::zlibDeflateStop(void)
+    {
+        streamOut = socket.get();
+        int res = zlib->deflateStop();
+
+        sendBytes += res;
+        socket->sendOverflow();
+        return res;
     }
 
     void ServerConnector::setFrameBuffer(const SWE::Surface & surf)
     {
-        if(surf.isValid() && (!fbPtr || fbSurf != surf))
+        // producer side: latest frame wins, never waits for network
+        if(surf.isValid())
+        {
+            const std::lock_guard<std::mutex> lock(frameLock);
+
+            if(frameUpdated)
+                frameSkipped++;
+
+            framePending = surf;
+            frameUpdated = true;
+        }
+
+        loop.wakeup();
+    }
+
+    bool ServerConnector::frameBufferApply(void)
+    {
+        SWE::Surface surf;
+
         {
-            const std::lock_guard<std::mutex> lock(sendGlobal);
-            fbSurf = surf;
+            const std::lock_guard<std::mutex> lock(frameLock);
+
+            if(! frameUpdated)
+                return false;
+
+            frameSource = framePending;
+            framePending.reset();
+            frameUpdated = false;
+
+            if(1 < debug && frameSkipped)
+                DEBUG("frames skipped: " << frameSkipped);
+            frameSkipped = 0;
+        }
+
+        // per listener or client output size, no upscale
+        Size sz = outputSize;
+
+        if(! sz.isEmpty())
+            sz = Size(std::min(int(sz.w), frameSource.width()), std::min(int(sz.h), frameSource.height()));
+
+        if(scaler)
+            surf = scaler->get(frameSource, sz);
+        else
+        if(! sz.isEmpty() && (sz.w != frameSource.width() || sz.h != frameSource.height()))
+            surf = SWE::Surface::scale(frameSource, SWE::Size(sz.w, sz.h), true);
+        else
+            surf = frameSource;
+
+        // same surface
+        if(fbPtr && ! (fbSurf != surf))
+            return false;
+
+        // no update in progress here, short lock
+        const std::lock_guard<std::mutex> lock(sendGlobal);
+        fbSurf = surf;
 
 #if (__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__)
-            bool bigEndian = false;
+        bool bigEndian = false;
 #else
-            bool bigEndian = true;
+        bool bigEndian = true;
 #endif
-            SDL_Surface* sf = fbSurf.toSDLSurface();
-            auto fmt = sf->format;
+        SDL_Surface* sf = fbSurf.toSDLSurface();
+        auto fmt = sf->format;
 
-            auto ptr = new FrameBuffer((uint8_t*) sf->pixels, Region(0, 0, sf->w, sf->h),
-                                    PixelFormat(fmt->BitsPerPixel, 24 /* vnc fixed depth */, bigEndian, true, fmt->Rmask, fmt->Gmask, fmt->Bmask), sf->pitch);
+        // size changed: notify client
+        if(fbPtr && (fbPtr->width() != sf->w || fbPtr->height() != sf->h) && desktopReason < 0)
+        {
+            desktopReason = 0;
+            desktopStatus = 0;
+        }
 
-            fbPtr.reset(ptr);
+        auto ptr = new FrameBuffer((uint8_t*) sf->pixels, Region(0, 0, sf->w, sf->h),
+                                PixelFormat(fmt->BitsPerPixel, 24 /* vnc fixed depth */, bigEndian, true, fmt->Rmask, fmt->Gmask, fmt->Bmask), sf->pitch);
 
-            clientUpdateReq = true;
-            clientRegion = fbPtr->region();
-        }
+        fbPtr.reset(ptr);
+        updatePixelConverter();
+        clientRegion = fbPtr->region();
+
+        return true;
     }
 }
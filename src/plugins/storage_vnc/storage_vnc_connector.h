@@ -23,9 +23,11 @@
 #ifndef _STORAGE_VNC_CONNECTOR_
 #define _STORAGE_VNC_CONNECTOR_
 
+#include <map>
 #include <list>
 #include <mutex>
 #include <memory>
+#include <thread>
 #include <future>
 #include <atomic>
 #include <functional>
@@ -37,11 +39,36 @@ namespace RFB
 {
     typedef std::function<void(const FrameBuffer &)> sendEncodingFunc;
 
+    /// adaptive encoding: tile classes
+    enum TileClass { TileClassPalette = 0, TileClassRuns = 1, TileClassPhoto = 2, TileClassCount = 3 };
+
+    /// adaptive encoding: moving average per pixel
+    struct EncodingStat
+    {
+        double          bytes;
+        double          usec;
+        size_t          stamp;
+
+        EncodingStat(double bpp = 0, double us = 0) : bytes(bpp), usec(us), stamp(0) {}
+    };
+
+    /// downscaled frames: one per output size, shared by connections
+    class SurfaceScaler
+    {
+        std::mutex      lock;
+        SWE::Surface    source;
+        std::map<std::pair<int, int>, SWE::Surface> scaled;
+
+    public:
+        SWE::Surface    get(const SWE::Surface &, const Size &);
+    };
+
     /* Connector::VNC */
     class ServerConnector : protected Network::BaseStream
     {
-        std::unique_ptr<Network::BaseStream> socket;        /// socket layer
-        std::unique_ptr<Network::DeflateStream> zlib;       /// zlib layer
+        std::unique_ptr<Network::TCPStream> socket;         /// socket layer
+        std::map<int, std::unique_ptr<Network::DeflateStream>> zlibStreams; /// zlib layer: stream per encoding
+        Network::DeflateStream* zlib;
 
         Network::BaseStream* streamIn;
         Network::BaseStream* streamOut;
@@ -49,10 +76,34 @@ namespace RFB
         int                 debug;
         int                 encodingDebug;
         int                 encodingThreads;
+        int                 zlibLevelMax;
+        int                 zlibLevel;
+        int                 zlibBudget;
+        bool                zlibAdaptive;
+        bool                adaptiveMode;
+        double              linkBandwidth;      /// bytes per usec
+        size_t              sendBytes;
+        size_t              adaptiveTiles;
+        std::vector<int>    adaptiveEncodings;
+        std::map<int, EncodingStat> adaptiveStats[TileClassCount];
         std::atomic<bool>   loopMessage;
         std::atomic<bool>   fbUpdateProcessing;
         std::atomic<bool>   clientUpdateReq;
+        std::mutex          frameLock;
+        SWE::Surface        framePending;
+        std::atomic<bool>   frameUpdated;
+        size_t              frameSkipped;
+        std::chrono::microseconds updateInterval;
+        std::chrono::steady_clock::time_point updateNext;
+        SurfaceScaler*      scaler;
+        SWE::Surface        frameSource;
+        Size                outputSize;
+        bool                clientResize;
+        bool                desktopAnnounced;
+        int                 desktopReason;
+        int                 desktopStatus;
         PixelFormat         clientFormat;
+        PixelConverter      clientConverter;
         Region              clientRegion;
         std::mutex          sendGlobal;
         std::mutex          sendEncoding;
@@ -64,6 +115,10 @@ namespace RFB
         std::unique_ptr<FrameBuffer> fbPtr;
         const SWE::JsonObject* config;
 
+        Network::EventLoop  loop;
+        std::vector<struct epoll_event> events;
+        std::thread         fbUpdateThread;
+
         // network stream interface
         void            sendFlush(void) override;
         void            sendRaw(const void* ptr, size_t len) override;
@@ -71,8 +126,11 @@ namespace RFB
         bool            hasInput(void) const override;
 
         // zlib wrapper
-        void            zlibDeflateStart(size_t);
-        int             zlibDeflateStop(bool uint16sz = false);
+        void            zlibDeflateStart(int type, bool uint16sz = false);
+        int             zlibDeflateStop(void);
+        int             zlibTargetLevel(void) const;
+        void            zlibAdaptLevel(const std::chrono::microseconds & net);
+        void            updateBandwidth(size_t bytes, const std::chrono::microseconds & elapsed, const std::chrono::microseconds & net);
 
     protected:
         bool            clientAuthVnc(bool);
@@ -84,30 +142,38 @@ namespace RFB
         void            clientCutTextEvent(void);
         void            clientDisconnectedEvent(void);
         void            clientEnableContinuousUpdates(void);
+        void            clientSetDesktopSize(void);
+        bool            clientSupported(int encoding) const;
 
         bool            serverSendFrameBufferUpdate(const Region &);
         void            serverSendBell(void);
         void            serverSendEndContinuousUpdates(void);
+        void            serverSendDesktopSize(void);
 
+        void            sendHeader(const Region &, int type);
+        void            updatePixelConverter(void);
         int             sendPixel(uint32_t pixel);
         int             sendCPixel(uint32_t pixel);
         int             sendRunLength(size_t length);
 
+        bool            frameBufferApply(void);
         bool            isUpdateProcessed(void) const;
         void            waitSendingFBUpdate(void) const;
 
+        void            runEncodingJobs(std::list<Region> &, const std::function<void(const Region &, int jobId)> &);
+
         void            sendEncodingRaw(const FrameBuffer &);
         void            sendEncodingRawSubRegion(const Point &, const Region &, const FrameBuffer &, int jobId);
         void            sendEncodingRawSubRegionRaw(const Region &, const FrameBuffer &);
 
         void            sendEncodingRRE(const FrameBuffer &, bool corre);
         void            sendEncodingRRESubRegion(const Point &, const Region &, const FrameBuffer &, int jobId, bool corre);
-        void            sendEncodingRRESubRects(const Region &, const FrameBuffer &, int jobId, int back, const std::list<RegionPixel> &, bool corre);
+        void            sendEncodingRRESubRects(const Region &, const FrameBuffer &, int jobId, int back, const std::vector<RegionPixel> &, bool corre);
 
         void            sendEncodingHextile(const FrameBuffer &, bool zlibver);
         void            sendEncodingHextileSubRegion(const Point &, const Region &, const FrameBuffer &, int jobId, bool zlibver);
-        void            sendEncodingHextileSubForeground(const Region &, const FrameBuffer &, int jobId, int back, const std::list<RegionPixel> &);
-        void            sendEncodingHextileSubColored(const Region &, const FrameBuffer &, int jobId, int back, const std::list<RegionPixel> &);
+        void            sendEncodingHextileSubForeground(const Region &, const FrameBuffer &, int jobId, int back, const std::vector<RegionPixel> &);
+        void            sendEncodingHextileSubColored(const Region &, const FrameBuffer &, int jobId, int back, const std::vector<RegionPixel> &);
         void            sendEncodingHextileSubRaw(const Region &, const FrameBuffer &, int jobId, bool zlibver);
 
         void            sendEncodingZLib(const FrameBuffer &);
@@ -115,17 +181,26 @@ namespace RFB
 
         void            sendEncodingTRLE(const FrameBuffer &, bool zrle);
         void            sendEncodingTRLESubRegion(const Point &, const Region &, const FrameBuffer &, int jobId, bool zrle);
-        void            sendEncodingTRLESubPacked(const Region &, const FrameBuffer &, int jobId, size_t field, const PixelMapWeight &, bool zrle);
-        void            sendEncodingTRLESubPlain(const Region &, const FrameBuffer &, const std::list<PixelLength> &);
-        void            sendEncodingTRLESubPalette(const Region &, const FrameBuffer &, const PixelMapWeight &, const std::list<PixelLength> &);
+        void            sendEncodingTRLETile(const Point &, const Region &, const FrameBuffer &, int jobId, bool limited, const PixelPalette &, const std::vector<PixelLength> &, bool zrle);
+        void            sendEncodingTRLESubTile(const Point &, const Region &, const FrameBuffer &, int jobId, bool limited, const PixelPalette &, const std::vector<PixelLength> &, bool zrle);
+        void            sendEncodingTRLESubPacked(const Region &, const FrameBuffer &, int jobId, size_t field, const PixelPalette &, const std::vector<PixelLength> &, bool zrle);
+        void            sendEncodingTRLESubPlain(const Region &, const FrameBuffer &, const std::vector<PixelLength> &);
+        void            sendEncodingTRLESubPalette(const Region &, const FrameBuffer &, const PixelPalette &, const std::vector<PixelLength> &);
         void            sendEncodingTRLESubRaw(const Region &, const FrameBuffer &);
 
+        void            sendEncodingAdaptive(const FrameBuffer &);
+        void            sendEncodingAdaptiveSubRegion(const Point &, const Region &, const FrameBuffer &, int jobId);
+        int             adaptiveSelect(TileClass);
+        void            adaptiveUpdate(TileClass, int type, size_t area, size_t bytes, const std::chrono::microseconds &);
+        void            adaptiveReset(void);
+
         std::pair<sendEncodingFunc, int> selectEncodings(void);
 
     public:
-        ServerConnector(TCPsocket sock, const SWE::JsonObject* jo);
+        ServerConnector(int sock, const SWE::JsonObject* jo, SurfaceScaler* sc = nullptr);
         ~ServerConnector();
 
+        std::string     peerAddress(void) const;
         int             communication(const std::string &);
         void            shutdown(void);
         void            setFrameBuffer(const SWE::Surface &);
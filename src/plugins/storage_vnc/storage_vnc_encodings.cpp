@@ -36,6 +36,16 @@ namespace RFB
 {
     std::pair<sendEncodingFunc, int> ServerConnector::selectEncodings(void)
     {
+        adaptiveReset();
+
+        if(! adaptiveEncodings.empty())
+        {
+            return std::make_pair([ = ](const FrameBuffer & fb)
+            {
+                return this->sendEncodingAdaptive(fb);
+            }, adaptiveEncodings.front());
+        }
+
         for(int type : clientEncodings)
         {
             switch(type)
@@ -111,43 +121,49 @@ namespace RFB
             DEBUG("send RAW region, job id: " << jobId << ", [" << reg.x << ", " << reg.y << ", " << reg.w << ", " << reg.h << "]");
         }
 
-        // region size
-        sendIntBE16(top.x + reg.x);
-        sendIntBE16(top.y + reg.y);
-        sendIntBE16(reg.w);
-        sendIntBE16(reg.h);
-        // region type
-        sendIntBE32(RFB::ENCODING_RAW);
+        sendHeader(reg + top, RFB::ENCODING_RAW);
         sendEncodingRawSubRegionRaw(reg, fb);
     }
 
     void ServerConnector::sendEncodingRawSubRegionRaw(const Region & reg, const FrameBuffer & fb)
     {
-        if(fb.pixelFormat() != clientFormat)
+        if(clientConverter.isCopy())
         {
-            for(auto coord = PointIterator(0, 0, reg.toSize()); coord.isValid(); ++coord)
-                sendPixel(fb.pixel(reg.topLeft() + coord));
+            for(int yy = 0; yy < reg.h; ++yy)
+                sendRaw(fb.pitchData(reg.y + yy) + reg.x * fb.bytePerPixel(), reg.w * fb.bytePerPixel());
         }
         else
         {
+            // convert by rows
+            thread_local std::vector<uint8_t> row;
+            row.resize(reg.w * clientFormat.bytePerPixel());
+
             for(int yy = 0; yy < reg.h; ++yy)
             {
-                sendRaw(fb.pitchData(reg.y + yy) + reg.x * fb.bytePerPixel(), fb.pitchSize());
+                auto len = clientConverter.convertRow(fb.pitchData(reg.y + yy) + reg.x * fb.bytePerPixel(), reg.w, row.data());
+                sendRaw(row.data(), len);
             }
         }
     }
 
-    std::list<RegionPixel> processingRRE(const Region & badreg, const FrameBuffer & fb, int skipPixel)
+    void processingRRE(const Region & badreg, const FrameBuffer & fb, int skipPixel, std::vector<RegionPixel> & goods)
     {
-        std::list<RegionPixel> goods;
-        std::list<Region> bads1 = { badreg };
-        std::list<Region> bads2;
+        thread_local std::vector<Region> bads1;
+        thread_local std::vector<Region> bads2;
+        thread_local std::vector<Region> subregs;
 
-        do
+        goods.clear();
+        bads1.assign(1, badreg);
+        bads2.clear();
+
+        while(! bads1.empty())
         {
-            while(! bads1.empty())
+            for(auto & bad : bads1)
             {
-                for(auto & subreg : Region::divideCounts(bads1.front(), 2, 2))
+                subregs.clear();
+                Region::divideCounts(bad, 2, 2, subregs);
+
+                for(auto & subreg : subregs)
                 {
                     auto pixel = fb.pixel(subreg.topLeft());
 
@@ -166,38 +182,22 @@ namespace RFB
                     else
                         bads2.push_back(subreg);
                 }
-
-                bads1.pop_front();
             }
 
-            if(bads2.empty())
-                break;
-
-            bads2.swap(bads1);
+            bads1.swap(bads2);
             bads2.clear();
         }
-        while(! bads1.empty());
-
-        return goods;
     }
 
-    /* RRE */
-    void ServerConnector::sendEncodingRRE(const FrameBuffer & fb, bool corre)
+    /* encoding pool: run func(region, jobId) for each region on encodingThreads */
+    void ServerConnector::runEncodingJobs(std::list<Region> & regions, const std::function<void(const Region &, int)> & func)
     {
-        const Region & reg0 = fb.region();
-        if(1 < debug)
-          DEBUG("encoding: " << (corre ? "CoRRE" : "RRE") << ", region: [" << reg0.x << ", " << reg0.y << ", " << reg0.w << ", " << reg0.h << "]");
-        const Point top(reg0.x, reg0.y);
-        const Size bsz = corre ? Size(64, 64) : Size(128, 128);
-        auto regions = Region::divideBlocks(reg0, bsz);
-        // regions counts
-        sendIntBE16(regions.size());
         int jobId = 1;
 
         // make pool jobs
         while(jobId <= encodingThreads && ! regions.empty())
         {
-            jobsEncodings.push_back(std::async(std::launch::async, & ServerConnector::sendEncodingRRESubRegion, this, top, regions.front() - top, fb, jobId, corre));
+            jobsEncodings.push_back(std::async(std::launch::async, func, regions.front(), jobId));
             regions.pop_front();
             jobId++;
         }
@@ -212,7 +212,7 @@ namespace RFB
 
                 if(job.wait_for(std::chrono::microseconds(100)) == std::future_status::ready)
                 {
-                    job = std::async(std::launch::async, & ServerConnector::sendEncodingRRESubRegion, this, top, regions.front() - top, fb, jobId, corre);
+                    job = std::async(std::launch::async, func, regions.front(), jobId);
                     regions.pop_front();
                     jobId++;
                 }
@@ -226,29 +226,40 @@ namespace RFB
         jobsEncodings.clear();
     }
 
+    /* RRE */
+    void ServerConnector::sendEncodingRRE(const FrameBuffer & fb, bool corre)
+    {
+        const Region & reg0 = fb.region();
+        if(1 < debug)
+          DEBUG("encoding: " << (corre ? "CoRRE" : "RRE") << ", region: [" << reg0.x << ", " << reg0.y << ", " << reg0.w << ", " << reg0.h << "]");
+        const Point top(reg0.x, reg0.y);
+        const Size bsz = corre ? Size(64, 64) : Size(128, 128);
+        auto regions = Region::divideBlocks(reg0, bsz);
+        // regions counts
+        sendIntBE16(regions.size());
+        runEncodingJobs(regions, [&](const Region & reg, int jobId)
+        {
+            this->sendEncodingRRESubRegion(top, reg - top, fb, jobId, corre);
+        });
+    }
+
     void ServerConnector::sendEncodingRRESubRegion(const Point & top, const Region & reg, const FrameBuffer & fb, int jobId, bool corre)
     {
-        auto map = fb.pixelMapWeight(reg);
-        auto sendHeaderRRE = [this](const Region & reg, bool corre)
-        {
-            // region size
-            this->sendIntBE16(reg.x);
-            this->sendIntBE16(reg.y);
-            this->sendIntBE16(reg.w);
-            this->sendIntBE16(reg.h);
-            // region type
-            this->sendIntBE32(corre ? RFB::ENCODING_CORRE : RFB::ENCODING_RRE);
-        };
+        thread_local PixelPalette pal;
+        thread_local std::vector<RegionPixel> goods;
+
+        pal.reset(PixelPalette::MaxSize);
+        bool limited = fb.pixelPalette(reg, pal);
 
-        if(map.empty())
+        if(pal.empty())
             throw std::runtime_error("ServerConnector::sendEncodingRRESubRegion: pixel map is empty");
 
-        if(map.size() > 1)
+        if(! limited || pal.size() > 1)
         {
-            int back = map.maxWeightPixel();
-            std::list<RegionPixel> goods = processingRRE(reg, fb, back);
-            const size_t rawLength = reg.h * fb.pitchSize();
-            const size_t rreLength = 4 + fb.bytePerPixel() + goods.size() * (fb.bytePerPixel() + (corre ? 4 : 8));
+            int back = limited ? pal.maxWeightPixel() : fb.pixelMapWeight(reg).maxWeightPixel();
+            processingRRE(reg, fb, back, goods);
+            const size_t rawLength = reg.w * reg.h * clientFormat.bytePerPixel();
+            const size_t rreLength = 4 + clientFormat.bytePerPixel() + goods.size() * (clientFormat.bytePerPixel() + (corre ? 4 : 8));
 
             // compare with raw
             if(rawLength < rreLength)
@@ -266,11 +277,11 @@ namespace RFB
                       SWE::String::hex(back) << ", sub rects: " << goods.size());
                 }
 
-                sendHeaderRRE(reg + top, corre);
+                sendHeader(reg + top, corre ? RFB::ENCODING_CORRE : RFB::ENCODING_RRE);
                 sendEncodingRRESubRects(reg, fb, jobId, back, goods, corre);
             }
         }
-        // if(map.size() == 1)
+        // solid
         else
         {
             int back = fb.pixel(reg.topLeft());
@@ -283,7 +294,7 @@ namespace RFB
                     " ], back pixel " << SWE::String::hex(back) << ", solid");
             }
 
-            sendHeaderRRE(reg + top, corre);
+            sendHeader(reg + top, corre ? RFB::ENCODING_CORRE : RFB::ENCODING_RRE);
             // num sub rects
             sendIntBE32(1);
             // back pixel
@@ -310,7 +321,7 @@ namespace RFB
         }
     }
 
-    void ServerConnector::sendEncodingRRESubRects(const Region & reg, const FrameBuffer & fb, int jobId, int back, const std::list<RegionPixel> & rreList, bool corre)
+    void ServerConnector::sendEncodingRRESubRects(const Region & reg, const FrameBuffer & fb, int jobId, int back, const std::vector<RegionPixel> & rreList, bool corre)
     {
         // num sub rects
         sendIntBE32(rreList.size());
@@ -359,62 +370,28 @@ namespace RFB
         auto regions = Region::divideBlocks(reg0, bsz);
         // regions counts
         sendIntBE16(regions.size());
-        int jobId = 1;
-
-        // make pool jobs
-        while(jobId <= encodingThreads && ! regions.empty())
+        runEncodingJobs(regions, [&](const Region & reg, int jobId)
         {
-            jobsEncodings.push_back(std::async(std::launch::async, & ServerConnector::sendEncodingHextileSubRegion, this, top, regions.front() - top, fb, jobId, zlibver));
-            regions.pop_front();
-            jobId++;
-        }
-
-        // renew completed job
-        while(! regions.empty())
-        {
-            for(auto & job : jobsEncodings)
-            {
-                if(regions.empty())
-                    break;
-
-                if(job.wait_for(std::chrono::microseconds(100)) == std::future_status::ready)
-                {
-                    job = std::async(std::launch::async, & ServerConnector::sendEncodingHextileSubRegion, this, top, regions.front() - top, fb, jobId, zlibver);
-                    regions.pop_front();
-                    jobId++;
-                }
-            }
-        }
-
-        // wait jobs
-        for(auto & job : jobsEncodings)
-            job.wait();
-
-        jobsEncodings.clear();
+            this->sendEncodingHextileSubRegion(top, reg - top, fb, jobId, zlibver);
+        });
     }
 
     void ServerConnector::sendEncodingHextileSubRegion(const Point & top, const Region & reg, const FrameBuffer & fb, int jobId, bool zlibver)
     {
-        auto map = fb.pixelMapWeight(reg);
-        auto sendHeaderHexTile = [this](const Region & reg, bool zlibver)
-        {
-            // region size
-            this->sendIntBE16(reg.x);
-            this->sendIntBE16(reg.y);
-            this->sendIntBE16(reg.w);
-            this->sendIntBE16(reg.h);
-            // region type
-            this->sendIntBE32(zlibver ? RFB::ENCODING_ZLIBHEX : RFB::ENCODING_HEXTILE);
-        };
+        thread_local PixelPalette pal;
+        thread_local std::vector<RegionPixel> goods;
 
-        if(map.empty())
+        pal.reset(PixelPalette::MaxSize);
+        bool limited = fb.pixelPalette(reg, pal);
+
+        if(pal.empty())
             throw std::runtime_error("ServerConnector::sendEncodingHextileSubRegion: pixel map is empty");
 
-        if(map.size() == 1)
+        if(limited && pal.size() == 1)
         {
             // wait thread
             const std::lock_guard<std::mutex> lock(sendEncoding);
-            sendHeaderHexTile(reg + top, zlibver);
+            sendHeader(reg + top, zlibver ? RFB::ENCODING_ZLIBHEX : RFB::ENCODING_HEXTILE);
             int back = fb.pixel(reg.topLeft());
 
             if(3 < debug)
@@ -428,22 +405,22 @@ namespace RFB
             sendInt8(RFB::HEXTILE_BACKGROUND);
             sendPixel(back);
         }
-        else if(map.size() > 1)
+        else
         {
             // no wait, worked
-            int back = map.maxWeightPixel();
-            std::list<RegionPixel> goods = processingRRE(reg, fb, back);
+            int back = limited ? pal.maxWeightPixel() : fb.pixelMapWeight(reg).maxWeightPixel();
+            processingRRE(reg, fb, back, goods);
             // all other color
             bool foreground = std::all_of(goods.begin(), goods.end(),
                               [col = goods.front().second](auto & pair) { return pair.pixel() == col; });
-            const size_t hextileRawLength = 1 + reg.h * fb.pitchSize();
+            const size_t hextileRawLength = 1 + reg.w * reg.h * clientFormat.bytePerPixel();
             // wait thread
             const std::lock_guard<std::mutex> lock(sendEncoding);
-            sendHeaderHexTile(reg + top, zlibver);
+            sendHeader(reg + top, zlibver ? RFB::ENCODING_ZLIBHEX : RFB::ENCODING_HEXTILE);
 
             if(foreground)
             {
-                const size_t hextileForegroundLength = 2 + 2 * fb.bytePerPixel() + goods.size() * 2;
+                const size_t hextileForegroundLength = 2 + 2 * clientFormat.bytePerPixel() + goods.size() * 2;
 
                 // compare with raw
                 if(hextileRawLength < hextileForegroundLength)
@@ -470,7 +447,7 @@ namespace RFB
             }
             else
             {
-                const size_t hextileColoredLength = 2 + fb.bytePerPixel() + goods.size() * (2 + fb.bytePerPixel());
+                const size_t hextileColoredLength = 2 + clientFormat.bytePerPixel() + goods.size() * (2 + clientFormat.bytePerPixel());
 
                 // compare with raw
                 if(hextileRawLength < hextileColoredLength)
@@ -498,7 +475,7 @@ namespace RFB
         }
     }
 
-    void ServerConnector::sendEncodingHextileSubColored(const Region & reg, const FrameBuffer & fb, int jobId, int back, const std::list<RegionPixel> & rreList)
+    void ServerConnector::sendEncodingHextileSubColored(const Region & reg, const FrameBuffer & fb, int jobId, int back, const std::vector<RegionPixel> & rreList)
     {
         // hextile flags
         sendInt8(RFB::HEXTILE_BACKGROUND | RFB::HEXTILE_COLOURED | RFB::HEXTILE_SUBRECTS);
@@ -523,7 +500,7 @@ namespace RFB
         }
     }
 
-    void ServerConnector::sendEncodingHextileSubForeground(const Region & reg, const FrameBuffer & fb, int jobId, int back, const std::list<RegionPixel> & rreList)
+    void ServerConnector::sendEncodingHextileSubForeground(const Region & reg, const FrameBuffer & fb, int jobId, int back, const std::vector<RegionPixel> & rreList)
     {
         // hextile flags
         sendInt8(RFB::HEXTILE_BACKGROUND | RFB::HEXTILE_FOREGROUND | RFB::HEXTILE_SUBRECTS);
@@ -554,9 +531,9 @@ namespace RFB
         {
             // hextile flags
             sendInt8(RFB::HEXTILE_ZLIBRAW);
-            zlibDeflateStart(reg.h * fb.pitchSize());
+            zlibDeflateStart(RFB::ENCODING_ZLIBHEX, true);
             sendEncodingRawSubRegionRaw(reg, fb);
-            zlibDeflateStop(true);
+            zlibDeflateStop();
         }
         else
         {
@@ -587,14 +564,8 @@ namespace RFB
                 jobId << ", [" << top.x + reg.x << ", " << top.y + reg.y << ", " << reg.w << ", " << reg.h << "]");
         }
     
-        // region size
-        sendIntBE16(top.x + reg.x);
-        sendIntBE16(top.y + reg.y);
-        sendIntBE16(reg.w);
-        sendIntBE16(reg.h);
-        // region type
-        sendIntBE32(RFB::ENCODING_ZLIB);
-        zlibDeflateStart(reg.h * fb.pitchSize());
+        sendHeader(reg + top, RFB::ENCODING_ZLIB);
+        zlibDeflateStart(RFB::ENCODING_ZLIB);
         sendEncodingRawSubRegionRaw(reg, fb);
         zlibDeflateStop();
     }
@@ -610,70 +581,68 @@ namespace RFB
         auto regions = Region::divideBlocks(reg0, bsz);
         // regions counts
         sendIntBE16(regions.size());
-        int jobId = 1;
+        runEncodingJobs(regions, [&](const Region & reg, int jobId)
+        {
+            this->sendEncodingTRLESubRegion(top, reg - top, fb, jobId, zrle);
+        });
+    }
 
-        // make pool jobs
-        while(jobId <= encodingThreads && ! regions.empty())
+    void ServerConnector::sendEncodingTRLESubRegion(const Point & top, const Region & reg, const FrameBuffer & fb, int jobId, bool zrle)
+    {
+        thread_local PixelPalette pal;
+        thread_local std::vector<PixelLength> rleList;
+
+        // rle palette size (2, 127)
+        pal.reset(127);
+        bool limited = fb.pixelPalette(reg, pal);
+        fb.toRLE(reg, rleList);
+
+        // wait thread
+        const std::lock_guard<std::mutex> lock(sendEncoding);
+        sendEncodingTRLETile(top, reg, fb, jobId, limited, pal, rleList, zrle);
+    }
+
+    void ServerConnector::sendEncodingTRLETile(const Point & top, const Region & reg, const FrameBuffer & fb, int jobId, bool limited, const PixelPalette & pal, const std::vector<PixelLength> & rleList, bool zrle)
+    {
+        sendHeader(reg + top, zrle ? RFB::ENCODING_ZRLE : RFB::ENCODING_TRLE);
+
+        if(zrle)
         {
-            jobsEncodings.push_back(std::async(std::launch::async, & ServerConnector::sendEncodingTRLESubRegion, this, top, regions.front() - top, fb, jobId, zrle));
-            regions.pop_front();
-            jobId++;
+            zlibDeflateStart(RFB::ENCODING_ZRLE);
+            sendEncodingTRLESubTile(top, reg, fb, jobId, limited, pal, rleList, zrle);
+            zlibDeflateStop();
         }
-
-        // renew completed job
-        while(! regions.empty())
+        else
+        if(reg.w <= 16 && reg.h <= 16)
         {
-            for(auto & job : jobsEncodings)
-            {
-                if(regions.empty())
-                    break;
+            sendEncodingTRLESubTile(top, reg, fb, jobId, limited, pal, rleList, zrle);
+        }
+        else
+        {
+            // rfb: trle tiles 16x16, zrle tiles 64x64
+            thread_local PixelPalette pal16;
+            thread_local std::vector<PixelLength> rleList16;
 
-                if(job.wait_for(std::chrono::microseconds(100)) == std::future_status::ready)
-                {
-                    job = std::async(std::launch::async, & ServerConnector::sendEncodingTRLESubRegion, this, top, regions.front() - top, fb, jobId, zrle);
-                    regions.pop_front();
-                    jobId++;
-                }
+            for(auto & sub : Region::divideBlocks(reg, Size(16, 16)))
+            {
+                pal16.reset(127);
+                bool limited16 = fb.pixelPalette(sub, pal16);
+                fb.toRLE(sub, rleList16);
+                sendEncodingTRLESubTile(top, sub, fb, jobId, limited16, pal16, rleList16, zrle);
             }
         }
-
-        // wait jobs
-        for(auto & job : jobsEncodings)
-            job.wait();
-
-        jobsEncodings.clear();
     }
 
-    void ServerConnector::sendEncodingTRLESubRegion(const Point & top, const Region & reg, const FrameBuffer & fb, int jobId, bool zrle)
+    void ServerConnector::sendEncodingTRLESubTile(const Point & top, const Region & reg, const FrameBuffer & fb, int jobId, bool limited, const PixelPalette & pal, const std::vector<PixelLength> & rleList, bool zrle)
     {
-        auto map = fb.pixelMapWeight(reg);
-        // convert to palette
-        int index = 0;
-
-        for(auto & pair : map)
-            pair.second = index++;
-
-        auto sendHeaderTRLE = [this](const Region & reg, bool zrle)
-        {
-            // region size
-            this->sendIntBE16(reg.x);
-            this->sendIntBE16(reg.y);
-            this->sendIntBE16(reg.w);
-            this->sendIntBE16(reg.h);
-            // region type
-            this->sendIntBE32(zrle ? RFB::ENCODING_ZRLE : RFB::ENCODING_TRLE);
+        auto runLength = [](size_t length)
+        {
+            return (length - 1) / 255 + 1;
         };
 
-        // wait thread
-        const std::lock_guard<std::mutex> lock(sendEncoding);
-        sendHeaderTRLE(reg + top, zrle);
-
-        if(zrle)
-            zlibDeflateStart(reg.h * fb.pitchSize());
-
-        if(map.size() == 1)
+        if(limited && pal.size() == 1)
         {
-            int back = fb.pixel(reg.topLeft());
+            int back = pal.pixels[0];
 
             if(3 < debug)
             {
@@ -686,39 +655,38 @@ namespace RFB
             sendInt8(1);
             sendCPixel(back);
         }
-        else if(2 <= map.size() && map.size() <= 16)
+        else if(limited && 2 <= pal.size() && pal.size() <= 16)
         {
             size_t field = 1;
 
-            if(4 < map.size())
+            if(4 < pal.size())
                 field = 4;
-            else if(2 < map.size())
+            else if(2 < pal.size())
                 field = 2;
 
             if(3 < debug)
             {
                 DEBUG("send " << (zrle ? "ZRLE" : "TRLE") << " region, job id: " <<
                     jobId << ", [" << top.x + reg.x << ", " << top.y + reg.y << ", " << reg.w << ", " << reg.h <<
-                    "], palsz: " << map.size() << ", packed: %d" << field);
+                    "], palsz: " << pal.size() << ", packed: " << field);
             }
 
-            sendEncodingTRLESubPacked(reg, fb, jobId, field, map, zrle);
+            sendEncodingTRLESubPacked(reg, fb, jobId, field, pal, rleList, zrle);
         }
         else
         {
-            auto rleList = fb.FrameBuffer::toRLE(reg);
             // rle plain size
             const size_t rlePlainLength = std::accumulate(rleList.begin(), rleList.end(), 1,
-                                          [](int v, auto & pair)
+                                          [&](size_t v, auto & pair)
             {
-                return v + 3 + std::floor((pair.second - 1) / 255.0) + 1;
+                return v + 3 + runLength(pair.length());
             });
             // rle palette size (2, 127)
-            const size_t rlePaletteLength = 1 < rleList.size() && rleList.size() < 128 ? std::accumulate(rleList.begin(), rleList.end(), 1 + 3 * map.size(),
-                                            [](int v, auto & pair)
+            const size_t rlePaletteLength = limited ? std::accumulate(rleList.begin(), rleList.end(), 1 + 3 * pal.size(),
+                                            [&](size_t v, auto & pair)
             {
-                return v + 1 + std::floor((pair.second - 1) / 255.0) + 1;
-            }) : 0xFFFF;
+                return v + (1 == pair.length() ? 1 : 1 + runLength(pair.length()));
+            }) : 0xFFFFFFFF;
             // raw length
             const size_t rawLength = 1 + 3 * reg.w * reg.h;
 
@@ -739,10 +707,10 @@ namespace RFB
                 {
                     DEBUG("send " << (zrle ? "ZRLE" : "TRLE") << " region, job id: " <<
                         jobId << ", [" << top.x + reg.x << ", " << top.y + reg.y << ", " << reg.w << ", " << reg.h <<
-                        "], pal size: " << map.size() << ", length: " << rleList.size() << ", rle palette");
+                        "], pal size: " << pal.size() << ", length: " << rleList.size() << ", rle palette");
                 }
 
-                sendEncodingTRLESubPalette(reg, fb, map, rleList);
+                sendEncodingTRLESubPalette(reg, fb, pal, rleList);
             }
             else
             {
@@ -755,34 +723,34 @@ namespace RFB
                 sendEncodingTRLESubRaw(reg, fb);
             }
         }
-
-        if(zrle)
-            zlibDeflateStop();
     }
 
-    void ServerConnector::sendEncodingTRLESubPacked(const Region & reg, const FrameBuffer & fb, int jobId, size_t field, const PixelMapWeight & pal, bool zrle)
+    void ServerConnector::sendEncodingTRLESubPacked(const Region & reg, const FrameBuffer & fb, int jobId, size_t field, const PixelPalette & pal, const std::vector<PixelLength> & rle, bool zrle)
     {
         // subencoding type: packed palette
         sendInt8(pal.size());
         // send palette
-        for(auto & pair : pal)
-            sendCPixel(pair.first);
+        for(size_t it = 0; it < pal.size(); ++it)
+            sendCPixel(pal.pixels[it]);
 
         Tools::StreamBitsPack sb;
+        size_t rowLength = 0;
 
-        // send packed rows
-        for(int oy = 0; oy < reg.h; ++oy)
+        // send packed rows: rle runs never cross the row
+        for(auto & pair : rle)
         {
-            for(int ox = 0; ox < reg.w; ++ox)
-            {
-                auto pixel = fb.pixel(reg.topLeft() + Point(ox, oy));
-                auto it = pal.find(pixel);
-                auto index = it != pal.end() ? (*it).second : 0;
+            auto index = std::max(0, pal.index(pair.pixel()));
 
+            for(size_t it = 0; it < pair.length(); ++it)
                 sb.pushValue(index, field);
-            }
 
-            sb.pushAlign();
+            rowLength += pair.length();
+
+            if(rowLength == reg.w)
+            {
+                sb.pushAlign();
+                rowLength = 0;
+            }
         }
 
         sendData(sb.toVector());
@@ -794,7 +762,7 @@ namespace RFB
         }
     }
 
-    void ServerConnector::sendEncodingTRLESubPlain(const Region & reg, const FrameBuffer & fb, const std::list<PixelLength> & rle)
+    void ServerConnector::sendEncodingTRLESubPlain(const Region & reg, const FrameBuffer & fb, const std::vector<PixelLength> & rle)
     {
         // subencoding type: rle plain
         sendInt8(128);
@@ -807,19 +775,18 @@ namespace RFB
         }
     }
 
-    void ServerConnector::sendEncodingTRLESubPalette(const Region & reg, const FrameBuffer & fb, const PixelMapWeight & pal, const std::list<PixelLength> & rle)
+    void ServerConnector::sendEncodingTRLESubPalette(const Region & reg, const FrameBuffer & fb, const PixelPalette & pal, const std::vector<PixelLength> & rle)
     {
         // subencoding type: rle palette
         sendInt8(pal.size() + 128);
         // send palette
-        for(auto & pair : pal)
-            sendCPixel(pair.first);
+        for(size_t it = 0; it < pal.size(); ++it)
+            sendCPixel(pal.pixels[it]);
 
         // send rle indexes
         for(auto & pair : rle)
         {
-            auto it = pal.find(pair.pixel());
-            auto index = it != pal.end() ? (*it).second : 0;
+            auto index = std::max(0, pal.index(pair.pixel()));
 
             if(1 == pair.length())
             {
@@ -842,4 +809,179 @@ namespace RFB
         for(auto coord = PointIterator(0, 0, reg.toSize()); coord.isValid(); ++coord)
             sendCPixel(fb.pixel(reg.topLeft() + coord));
     }
+
+    /* Adaptive: encoding per tile */
+    void ServerConnector::adaptiveReset(void)
+    {
+        adaptiveEncodings.clear();
+
+        if(adaptiveMode)
+        {
+            // client order, encodings with per tile rectangles only
+            for(int type : clientEncodings)
+            {
+                if((type == RFB::ENCODING_ZLIB || type == RFB::ENCODING_TRLE || type == RFB::ENCODING_ZRLE) &&
+                    std::none_of(adaptiveEncodings.begin(), adaptiveEncodings.end(), [=](auto & val){ return val == type; }))
+                    adaptiveEncodings.push_back(type);
+            }
+        }
+
+        // nothing to choose
+        if(adaptiveEncodings.empty())
+            return;
+
+        adaptiveEncodings.push_back(RFB::ENCODING_RAW);
+
+        // initial estimates (bytes and usec per pixel), corrected by measured tiles
+        const double bpp = clientFormat.bytePerPixel();
+        const double cpp = clientFormat.trueColor() && clientFormat.bitsPerPixel == 32 ? 3 : bpp;
+
+        adaptiveStats[TileClassPalette] = { { RFB::ENCODING_RAW, EncodingStat(bpp, 0.002) }, { RFB::ENCODING_ZLIB, EncodingStat(bpp * 0.1, 0.02) },
+                                            { RFB::ENCODING_TRLE, EncodingStat(0.6, 0.02) }, { RFB::ENCODING_ZRLE, EncodingStat(0.15, 0.03) } };
+        adaptiveStats[TileClassRuns] =    { { RFB::ENCODING_RAW, EncodingStat(bpp, 0.002) }, { RFB::ENCODING_ZLIB, EncodingStat(bpp * 0.25, 0.03) },
+                                            { RFB::ENCODING_TRLE, EncodingStat(1.0, 0.02) }, { RFB::ENCODING_ZRLE, EncodingStat(0.4, 0.04) } };
+        adaptiveStats[TileClassPhoto] =   { { RFB::ENCODING_RAW, EncodingStat(bpp, 0.002) }, { RFB::ENCODING_ZLIB, EncodingStat(bpp * 0.6, 0.04) },
+                                            { RFB::ENCODING_TRLE, EncodingStat(cpp + 0.05, 0.03) }, { RFB::ENCODING_ZRLE, EncodingStat(cpp * 0.6, 0.06) } };
+    }
+
+    int ServerConnector::adaptiveSelect(TileClass cls)
+    {
+        auto & stats = adaptiveStats[cls];
+        int res = RFB::ENCODING_RAW;
+        adaptiveTiles++;
+
+        // probe: refresh the oldest estimate
+        if(0 == adaptiveTiles % 32)
+        {
+            // slow link (below 100 Mbit/s): raw tiles never pay off, do not probe them
+            const bool skipRaw = linkBandwidth < 12.5;
+            size_t stamp = adaptiveTiles;
+            res = adaptiveEncodings.front();
+
+            for(int type : adaptiveEncodings)
+            {
+                if(skipRaw && type == RFB::ENCODING_RAW)
+                    continue;
+
+                auto & st = stats[type];
+                if(st.stamp < stamp)
+                {
+                    stamp = st.stamp;
+                    res = type;
+                }
+            }
+        }
+        else
+        {
+            // cost: encode time and transfer time per pixel
+            double cost = 0;
+
+            for(int type : adaptiveEncodings)
+            {
+                auto & st = stats[type];
+                double val = st.usec + st.bytes / linkBandwidth;
+
+                if(type == adaptiveEncodings.front() || val < cost)
+                {
+                    cost = val;
+                    res = type;
+                }
+            }
+        }
+
+        return res;
+    }
+
+    void ServerConnector::adaptiveUpdate(TileClass cls, int type, size_t area, size_t bytes, const std::chrono::microseconds & elapsed)
+    {
+        if(0 == area)
+            return;
+
+        auto & st = adaptiveStats[cls][type];
+
+        st.bytes = 0.75 * st.bytes + 0.25 * bytes / area;
+        st.usec = 0.75 * st.usec + 0.25 * elapsed.count() / area;
+        st.stamp = adaptiveTiles;
+    }
+
+    void ServerConnector::sendEncodingAdaptive(const FrameBuffer & fb)
+    {
+        const Region & reg0 = fb.region();
+        if(1 < debug)
+            DEBUG("encoding: Adaptive, region: [ " << reg0.x << ", " << reg0.y << ", " << reg0.w << ", " << reg0.h << "]");
+        const Point top(reg0.x, reg0.y);
+        const Size bsz = Size(64, 64);
+        auto regions = Region::divideBlocks(reg0, bsz);
+        // regions counts
+        sendIntBE16(regions.size());
+        runEncodingJobs(regions, [&](const Region & reg, int jobId)
+        {
+            this->sendEncodingAdaptiveSubRegion(top, reg - top, fb, jobId);
+        });
+    }
+
+    void ServerConnector::sendEncodingAdaptiveSubRegion(const Point & top, const Region & reg, const FrameBuffer & fb, int jobId)
+    {
+        thread_local PixelPalette pal;
+        thread_local std::vector<PixelLength> rleList;
+
+        // tile statistics: palette and runs
+        pal.reset(127);
+        bool limited = fb.pixelPalette(reg, pal);
+        fb.toRLE(reg, rleList);
+
+        const size_t area = reg.w * reg.h;
+        const bool solid = limited && pal.size() == 1;
+        TileClass cls = TileClassPhoto;
+
+        if(limited && pal.size() <= 16)
+            cls = TileClassPalette;
+        else if(rleList.size() * 4 < area)
+            cls = TileClassRuns;
+
+        // wait thread
+        const std::lock_guard<std::mutex> lock(sendEncoding);
+        int type = RFB::ENCODING_RAW;
+
+        // solid: trle subencoding always the smallest
+        auto it = solid ? std::find_if(adaptiveEncodings.begin(), adaptiveEncodings.end(),
+                    [](auto & val){ return val == RFB::ENCODING_TRLE || val == RFB::ENCODING_ZRLE; }) : adaptiveEncodings.end();
+
+        if(it != adaptiveEncodings.end())
+            type = *it;
+        else
+            type = adaptiveSelect(cls);
+
+        if(3 < debug)
+        {
+            DEBUG("send Adaptive region, job id: " << jobId << ", [" << top.x + reg.x << ", " << top.y + reg.y << ", " << reg.w << ", " << reg.h <<
+                    "], class: " << cls << ", encoding: " << RFB::encodingName(type));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        size_t bytes = sendBytes;
+
+        switch(type)
+        {
+            case RFB::ENCODING_TRLE:
+            case RFB::ENCODING_ZRLE:
+                sendEncodingTRLETile(top, reg, fb, jobId, limited, pal, rleList, type == RFB::ENCODING_ZRLE);
+                break;
+
+            case RFB::ENCODING_ZLIB:
+                sendHeader(reg + top, RFB::ENCODING_ZLIB);
+                zlibDeflateStart(RFB::ENCODING_ZLIB);
+                sendEncodingRawSubRegionRaw(reg, fb);
+                zlibDeflateStop();
+                break;
+
+            default:
+                sendHeader(reg + top, RFB::ENCODING_RAW);
+                sendEncodingRawSubRegionRaw(reg, fb);
+                break;
+        }
+
+        if(it == adaptiveEncodings.end())
+            adaptiveUpdate(cls, type, area, sendBytes - bytes, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+    }
 }
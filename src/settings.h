@@ -23,12 +23,22 @@
 #ifndef _CNA_SETTINGS_
 #define _CNA_SETTINGS_
 
+#include <ctime>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include "libswe.h"
 using namespace SWE;
 
+#if ! defined(__WIN32__)
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
 #define VERSION 20230227
 #define PLUGIN_API 20220406
 
@@ -81,6 +91,182 @@ namespace Settings
     std::string		dataPath(void);
 }
 
+/* format string parsed once: strftime text and ${name} variables,
+   the strftime result cached per second, not thread safe */
+class FormatTemplate
+{
+    struct Token
+    {
+        std::string     text;
+        bool            variable;
+        bool            strftime;
+    };
+
+    std::vector<Token>  tokens;
+    mutable std::vector<std::string> cache;
+    mutable time_t      cacheTime;
+
+    static std::string  strftime(const std::string & format, const struct tm & tm)
+    {
+        std::string res(format.size() + 64, 0);
+
+        while(res.size() < 4096)
+        {
+            size_t len = std::strftime(& res[0], res.size(), format.c_str(), & tm);
+            if(0 < len)
+                return res.substr(0, len);
+            res.resize(res.size() * 2);
+        }
+
+        return std::string();
+    }
+
+public:
+    FormatTemplate() : cacheTime(-1) {}
+    explicit FormatTemplate(const std::string & format) : cacheTime(-1)
+    {
+        size_t pos = 0;
+
+        while(pos < format.size())
+        {
+            auto var = format.find("${", pos);
+            auto end = var == std::string::npos ? var : format.find('}', var + 2);
+
+            if(end == std::string::npos)
+                var = format.size();
+
+            if(pos < var)
+            {
+                std::string text = format.substr(pos, var - pos);
+                bool time = text.find('%') != std::string::npos;
+                tokens.push_back(Token{ std::move(text), false, time });
+            }
+
+            if(var < format.size())
+            {
+                tokens.push_back(Token{ format.substr(var + 2, end - var - 2), true, false });
+                pos = end + 1;
+            }
+            else
+                pos = var;
+        }
+
+        cache.resize(tokens.size());
+    }
+
+    bool                empty(void) const { return tokens.empty(); }
+
+    // Func: bool(const std::string & name, std::string & value), unknown variables stay as is
+    template<typename Func>
+    std::string         render(const Func & variable) const
+    {
+        time_t now = std::time(nullptr);
+
+        if(now != cacheTime)
+        {
+            struct tm tm;
+            localtime_r(& now, & tm);
+
+            for(size_t it = 0; it < tokens.size(); ++it)
+                if(tokens[it].strftime) cache[it] = strftime(tokens[it].text, tm);
+
+            cacheTime = now;
+        }
+
+        std::string res, value;
+
+        for(size_t it = 0; it < tokens.size(); ++it)
+        {
+            auto & token = tokens[it];
+
+            if(token.variable)
+            {
+                value.clear();
+
+                if(variable(token.text, value))
+                    res.append(value);
+                else
+                    res.append("${").append(token.text).append("}");
+            }
+            else
+                res.append(token.strftime ? cache[it] : token.text);
+        }
+
+        return res;
+    }
+
+    // storage plugins: ${sid}, ${session} and ${seq} variables
+    std::string         render(size_t sid, const std::string & session, size_t seq = 0) const
+    {
+        return render([&](const std::string & name, std::string & value)
+        {
+            if(0 < sid && name == "sid")
+                value = std::to_string(sid);
+            else
+            if(! session.empty() && name == "session")
+                value = session;
+            else
+            if(0 < seq && name == "seq")
+                value = std::to_string(seq);
+            else
+                return false;
+
+            return true;
+        });
+    }
+};
+
+#if ! defined(__WIN32__)
+/* shell command started as coprocess in own process group,
+   stopped with the group: SIGTERM, wait, SIGKILL */
+namespace Coprocess
+{
+    /// fdIn, fdOut: child stdin and stdout (if >= 0), return pid or -1 (errno)
+    inline pid_t spawn(const std::string & command, int fdIn, int fdOut)
+    {
+        pid_t pid = fork();
+
+        if(0 == pid)
+        {
+            setpgid(0, 0);
+
+            if(0 <= fdIn)
+                dup2(fdIn, STDIN_FILENO);
+            if(0 <= fdOut)
+                dup2(fdOut, STDOUT_FILENO);
+
+            execl("/bin/sh", "sh", "-c", command.c_str(), nullptr);
+            _exit(127);
+        }
+
+        // also parent, before the kill
+        if(0 < pid)
+            setpgid(pid, pid);
+
+        return pid;
+    }
+
+    inline void terminate(pid_t pid, const std::chrono::milliseconds & timeout = std::chrono::seconds(1))
+    {
+        if(0 >= pid)
+            return;
+
+        ::kill(-pid, SIGTERM);
+
+        for(auto wait = std::chrono::milliseconds(0); wait < timeout; wait += std::chrono::milliseconds(10))
+        {
+            if(0 != waitpid(pid, nullptr, WNOHANG))
+                return;
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        ::kill(-pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+}
+#endif
+
 struct Frames : protected std::list<Surface>
 {
     mutable std::mutex mt;
@@ -112,6 +298,21 @@ struct Frames : protected std::list<Surface>
         std::list<Surface>::push_back(sf);
     }
 
+    /// queue is full: replace the last queued frame, return false if replaced
+    bool push_back(const Surface & sf, size_t limit)
+    {
+        const std::lock_guard<std::mutex> lock(mt);
+
+        if(1 < limit && limit <= std::list<Surface>::size())
+        {
+            std::list<Surface>::back() = sf;
+            return false;
+        }
+
+        std::list<Surface>::push_back(sf);
+        return true;
+    }
+
     void emplace_back(Surface && sf)
     {
         const std::lock_guard<std::mutex> lock(mt);
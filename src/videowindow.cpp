@@ -73,11 +73,13 @@ WindowParams::WindowParams(const JsonObject & jo, const MainScreen* main) : skip
 
 /* VideoWindow */
 VideoWindow::VideoWindow(const WindowParams & params, Window & parent)
-    : Window(params.position, params.position, & parent), WindowParams(params)
+    : Window(params.position, params.position, & parent), WindowParams(params), exportDirty(true), firstFrame(true)
 {
     if(labelName.empty())
 	labelName = String::hex(Window::id());
 
+    labelTemplate = FormatTemplate(labelFormat);
+
     if(params.skip)
         throw std::invalid_argument("skip window");
 
@@ -155,9 +157,54 @@ VideoWindow::VideoWindow(const WindowParams & params, Window & parent)
 	}
     }
 
+    buildSignalIndex();
     setVisible(true);
 }
 
+void VideoWindow::buildSignalIndex(void)
+{
+    for(auto & plugin : storagePlugins)
+    {
+        bool tick = false;
+        bool click = false;
+
+        for(auto & signal : plugin->signalNames())
+        {
+            signalIndex[signal].emplace_back(& plugin, signal);
+
+            // tick: first only, period parsed by plugin
+            if(! tick && 0 == signal.compare(0, 5, "tick:"))
+            {
+                tickSubscribers.emplace_back(& plugin, signal);
+                tick = true;
+            }
+            else
+            if(! click && 0 == signal.compare(0, 11, "mouse:click"))
+            {
+                clickSubscribers.emplace_back(& plugin, signal);
+                click = true;
+            }
+            else
+            if(0 == signal.compare(0, 4, "key:"))
+            {
+                keyIndex[String::toUpper(signal.substr(4))].emplace_back(& plugin, signal);
+            }
+        }
+    }
+
+    DEBUG("window label: " << labelName << ", signals: " << signalIndex.size() << ", keys: " << keyIndex.size());
+}
+
+std::list<std::string> VideoWindow::signalNames(void) const
+{
+    std::list<std::string> res;
+
+    for(auto & pair : signalIndex)
+        res.push_back(pair.first);
+
+    return res;
+}
+
 Surface VideoWindow::generateBlueScreen(const std::string & label, const Size & winsz, const FontRender & frs)
 {
     auto res = Surface(winsz);
@@ -169,9 +216,60 @@ Surface VideoWindow::generateBlueScreen(const std::string & label, const Size &
     return res;
 }
 
+bool VideoWindow::updateFrameTexture(const Surface & sf)
+{
+    SDL_Surface* ptr = sf.toSDLSurface();
+
+    // persistent texture, recreated if the frame size changed
+    if(! frameTexture.isValid() || frameTexture.size() != sf.size())
+        frameTexture = Display::createTexture(sf.size());
+
+    SDL_Texture* tx = frameTexture.toSDLTexture();
+    uint32_t format = 0;
+
+    if(! ptr || ! tx || 0 != SDL_QueryTexture(tx, & format, nullptr, nullptr, nullptr))
+        return false;
+
+    // texture format: direct upload
+    if(ptr->format->format == format)
+        return 0 == SDL_UpdateTexture(tx, nullptr, ptr->pixels, ptr->pitch);
+
+    // other: one conversion for frame, not for repaint
+    SDL_Surface* tmp = SDL_ConvertSurfaceFormat(ptr, format, 0);
+    if(! tmp)
+        return false;
+
+    int res = SDL_UpdateTexture(tx, nullptr, tmp->pixels, tmp->pitch);
+    SDL_FreeSurface(tmp);
+
+    return 0 == res;
+}
+
+Rect VideoWindow::frameArea(const Size & sz) const
+{
+    Size zoom = sz;
+
+    // scale to window, keep aspect
+    if(capturePlugin && capturePlugin->isScaleImage() && sz != size() &&
+        0 < sz.w && 0 < sz.h)
+    {
+        float scaleX = width() / static_cast<float>(sz.w);
+        float scaleY = height() / static_cast<float>(sz.h);
+        float factor = scaleY < scaleX ? scaleY : scaleX;
+        zoom = Size(sz.w * factor, sz.h * factor);
+    }
+
+    return Rect(Point((size() - zoom) / 2), zoom);
+}
+
 void VideoWindow::renderWindow(void)
 {
-    // capture
+    // capture: scaled by renderer
+    if(frameTexture.isValid())
+    {
+        renderTexture(frameTexture, frameTexture.rect(), frameArea(frameTexture.size()));
+    }
+    else
     if(back.isValid())
     {
 	Rect rt1 = back.rect();
@@ -188,32 +286,96 @@ void VideoWindow::renderWindow(void)
     const MainScreen* scr = dynamic_cast<const MainScreen*>(parent());
     if(scr && ! labelColor.isTransparent())
     {
-        std::string labelText = labelName;
+        auto text = labelText();
 
-        if(! labelFormat.empty())
+        // render glyphs only if text changed
+        if(text != labelRendered || ! labelTexture.isValid())
         {
-            labelText = scr->formatString(labelFormat);
-            labelText = String::strftime(labelText);
-            labelText = String::replace(labelText, "${label}", labelName);
+            labelTexture = text.empty() ? Texture() : Display::renderText(scr->fontRender(), text, labelColor);
+            labelRendered = text;
         }
 
-	renderText(scr->fontRender(), labelText, labelColor, labelPos);
+        if(labelTexture.isValid())
+            renderTexture(labelTexture, labelPos);
     }
 }
 
+std::string VideoWindow::labelText(void) const
+{
+    const MainScreen* scr = dynamic_cast<const MainScreen*>(parent());
+
+    if(scr && ! labelTemplate.empty())
+    {
+        return labelTemplate.render([&](const std::string & name, std::string & value)
+        {
+            if(name != "label")
+                return scr->formatVariable(name, value);
+
+            value = labelName;
+            return true;
+        });
+    }
+
+    return labelName;
+}
+
+bool VideoWindow::isExportDirty(void) const
+{
+    return exportDirty || (! labelFormat.empty() && ! labelColor.isTransparent() && exportLabel != labelText());
+}
+
+void VideoWindow::renderExport(Surface & dst, const Surface & background)
+{
+    const Rect & pos = area();
+    SDL_Surface* sfd = dst.toSDLSurface();
+
+    // window area: background
+    SDL_Rect srt = { pos.x, pos.y, pos.w, pos.h };
+    SDL_Rect drt = srt;
+    SDL_BlitSurface(background.toSDLSurface(), & srt, sfd, & drt);
+
+    // capture: centered, clipped to window
+    if(back.isValid())
+    {
+        const Rect frame = frameArea(back.size());
+        const Surface sf = frame.toSize() == back.size() ? back : Surface::scale(back, frame.toSize(), true);
+
+        int dx = (pos.w - sf.width()) / 2;
+        int dy = (pos.h - sf.height()) / 2;
+
+        srt = { std::max(0, -dx), std::max(0, -dy), std::min(sf.width(), int(pos.w)), std::min(sf.height(), int(pos.h)) };
+        drt = { pos.x + std::max(0, dx), pos.y + std::max(0, dy), srt.w, srt.h };
+        SDL_BlitSurface(sf.toSDLSurface(), & srt, sfd, & drt);
+    }
+    else
+    {
+        Surface fill(pos.toSize());
+        fill.clear(fillColor);
+
+        drt = { pos.x, pos.y, pos.w, pos.h };
+        SDL_BlitSurface(fill.toSDLSurface(), nullptr, sfd, & drt);
+    }
+
+    // label
+    const MainScreen* scr = dynamic_cast<const MainScreen*>(parent());
+    exportLabel = labelText();
+
+    if(scr && ! labelColor.isTransparent())
+        scr->fontRender().renderString(exportLabel, labelColor, pos.toPoint() + labelPos, dst);
+
+    exportDirty = false;
+}
+
 void VideoWindow::tickEvent(u32 ms)
 {
     if(capturePlugin && capturePlugin->isInitComplete())
     {
-        for(auto & plugin : storagePlugins)
+        for(auto & [slot, signalName] : tickSubscribers)
         {
-	    if(plugin && plugin->isInitComplete() && plugin->isTickEvent(ms))
-	    {
-                auto signalName = plugin->findSignal("tick:", false);
-		if(signalName.empty()) continue;
+            auto & plugin = *slot;
 
+	    if(plugin && plugin->isInitComplete() && plugin->isTickEvent(ms))
                 plugin->storeAction(signalName);
-	    }
 	}
     }
 }
@@ -226,7 +388,6 @@ bool VideoWindow::userEvent(int act, void* data)
 	case ActionCaptureReset:        return actionCaptureReset(data);
 	case ActionStorageReset:        return actionStorageReset(data);
 	case ActionStorageBack:         return actionStorageBack(data);
-	case ActionSignalName:          return actionSignalName(data);
 	default: break;
     }
 
@@ -252,23 +413,23 @@ bool VideoWindow::actionFrameComplete(void* data)
 	    if(plugin && plugin->isInitComplete())
         	plugin->setSurface(sf);
 
-        // scale
-        if(capturePlugin->isScaleImage() &&
-            sf.size() != back.size())
-        {
-            float scaleX = width() / static_cast<float>(sf.width());
-            float scaleY = height() / static_cast<float>(sf.height());
-            float factor = scaleY < scaleX ? scaleY : scaleX;
-            Size zoom(sf.width() * factor, sf.height() * factor);
+        // upload once for frame, the scale in render
+        back = sf;
 
-            back = Surface::scale(sf, zoom, true);
-        }
-        else
+        if(! updateFrameTexture(back))
         {
-            back = sf;
+            ERROR("window label: " << labelName << ", texture update failed");
+            frameTexture.reset();
         }
 
+        exportDirty = true;
         DisplayScene::setDirty(true);
+
+        if(firstFrame)
+        {
+            StartupTimeline::mark(labelName, "first frame");
+            firstFrame = false;
+        }
     }
 
     return true;
@@ -279,19 +440,8 @@ bool VideoWindow::actionCaptureReset(void* data)
     if(! capturePlugin->isData(data))
         return false;
 
-    // copy params
-    auto params = capturePlugin->pluginParams();
-    // unload dl
-    capturePlugin.reset();
-    std::this_thread::sleep_for(100ms);
-    capturePlugin.reset(new CapturePlugin(params, *this));
-
-    auto screen = static_cast<MainScreen*>(parent());
-    if(screen)
-    {
-        back = generateBlueScreen(_("initialize"), size(), screen->fontRender());
-        DisplayScene::setDirty(true);
-    }
+    // keep last frame, reconnect with backoff from plugin thread
+    capturePlugin->reconnect();
 
     return true;
 }
@@ -330,36 +480,20 @@ bool VideoWindow::actionStorageBack(void* data)
     return false;
 }
 
-bool VideoWindow::actionSignalName(void* data)
+void VideoWindow::actionSignalName(const std::string & signalName)
 {
-    if(auto name = static_cast<std::string*>(data))
-        actionSignalName(*name);
+    auto it = signalIndex.find(signalName);
 
-    // broadcast
-    return false;
-}
-
-void VideoWindow::actionSignalName(const std::string & signalName2)
-{
-    if(capturePlugin && capturePlugin->isInitComplete())
+    if(it != signalIndex.end() && capturePlugin && capturePlugin->isInitComplete())
     {
-        // lookfor storage
-        for(auto & plugin : storagePlugins)
+        for(auto & [slot, name] : (*it).second)
         {
-            if(plugin && plugin->isInitComplete())
-            {
-                auto signalName = plugin->findSignal(signalName2, true);
-                if(signalName.empty()) continue;
+            auto & plugin = *slot;
 
-                plugin->storeAction(signalName);
-            }
+            if(plugin && plugin->isInitComplete())
+                plugin->storeAction(name);
         }
     }
-
-    if(auto scr = dynamic_cast<MainScreen*>(parent()))
-    {
-	scr->actionSignalName(signalName2, this);
-    }
 }
 
 bool VideoWindow::mousePressEvent(const ButtonEvent & coord)
@@ -367,14 +501,12 @@ bool VideoWindow::mousePressEvent(const ButtonEvent & coord)
     // internal signal: mouse:click
     if(capturePlugin && capturePlugin->isInitComplete() && coord.isButtonLeft())
     {
-        for(auto & plugin : storagePlugins)
+        for(auto & [slot, signalName] : clickSubscribers)
 	{
+            auto & plugin = *slot;
+
 	    if(plugin && plugin->isInitComplete())
 	    {
-                auto signalName = plugin->findSignal("mouse:click", false);
-	        if(signalName.empty()) continue;
-
-	        //DEBUG("receive signal: " << signalName);
                 plugin->storeAction(signalName);
 	        return true;
 	    }
@@ -387,21 +519,18 @@ bool VideoWindow::mousePressEvent(const ButtonEvent & coord)
 bool VideoWindow::keyPressEvent(const KeySym & key)
 {
     // internal signal: key:keyname
-    if(capturePlugin && capturePlugin->isInitComplete())
+    auto it = keyIndex.find(key.keyname());
+
+    if(it != keyIndex.end() && capturePlugin && capturePlugin->isInitComplete())
     {
-        for(auto & plugin : storagePlugins)
+        for(auto & [slot, signalName] : (*it).second)
 	{
+            auto & plugin = *slot;
+
 	    if(plugin && plugin->isInitComplete())
 	    {
-	        auto signalName = plugin->findSignal("key:", false);
-                if(signalName.empty()) continue;
-
-                auto keyName = String::toUpper(signalName.substr(4, signalName.size() - 4));
-	        if(keyName == key.keyname())
-	        {
-		    plugin->storeAction(signalName);
-		    return true;
-	        }
+		plugin->storeAction(signalName);
+		return true;
             }
 	}
     }
@@ -25,6 +25,7 @@
 
 #include <list>
 #include <memory>
+#include <unordered_map>
 
 #include "settings.h"
 #include "plugins.h"
@@ -47,12 +48,28 @@ struct WindowParams
     WindowParams(const JsonObject &, const MainScreen*);
 };
 
+// storage plugin slot and the subscribed signal name
+typedef std::pair<std::unique_ptr<StoragePlugin>*, std::string> SignalSubscriber;
+
 class VideoWindow : public Window, protected WindowParams
 {
     std::unique_ptr<CapturePlugin> capturePlugin;
     std::list< std::unique_ptr<StoragePlugin> > storagePlugins;
 
+    // signals index: compiled from storage plugins at load
+    std::unordered_map<std::string, std::list<SignalSubscriber>> signalIndex;
+    std::unordered_map<std::string, std::list<SignalSubscriber>> keyIndex;
+    std::list<SignalSubscriber> tickSubscribers;
+    std::list<SignalSubscriber> clickSubscribers;
+
     Surface		back;
+    Texture             frameTexture;
+    FormatTemplate      labelTemplate;
+    Texture             labelTexture;
+    std::string         labelRendered;
+    bool                exportDirty;
+    bool                firstFrame;
+    std::string         exportLabel;
 
 protected:
     void		tickEvent(u32 ms) override;
@@ -64,9 +81,11 @@ protected:
     bool                actionCaptureReset(void* data);
     bool                actionStorageReset(void* data);
     bool                actionStorageBack(void* data);
-    bool                actionSignalName(void* data);
 
     Surface             generateBlueScreen(const std::string &, const Size &, const FontRender &);
+    void                buildSignalIndex(void);
+    bool                updateFrameTexture(const Surface &);
+    Rect                frameArea(const Size &) const;
 
 public:
     VideoWindow(const WindowParams &, Window & parent);
@@ -80,8 +99,14 @@ public:
     void		renderWindow(void) override;
     void		stopCapture(void);
 
+    std::string         labelText(void) const;
+    bool                isExportDirty(void) const;
+    void                setExportDirty(void) { exportDirty = true; }
+    void                renderExport(Surface &, const Surface & background);
+
     void                actionSessionReset(const SessionIdName &);
     void                actionSignalName(const std::string &);
+    std::list<std::string> signalNames(void) const;
 };
 
 #endif